@@ -0,0 +1,336 @@
+#include "rangeset.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <set>
+
+template <typename F>
+double time_ms(F && f){
+  auto && start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Build a set from a monotonically growing stream of ranges (one in two touching the previous one) with insert(), a hinted insert() and append().
+ */
+template <typename Set>
+void bench_monotonic(const char * name, int n){
+  size_t check = 0;
+  double plain = time_ms([&]{
+    Set set;
+    for(int i = 0 ; i < n ; ++i){
+      set.insert(3 * i, 3 * i + 2 + i % 2);
+    }
+    check += set.size();
+  });
+  double hinted = time_ms([&]{
+    Set set;
+    auto && hint = set.cend();
+    for(int i = 0 ; i < n ; ++i){
+      hint = set.insert(hint, 3 * i, 3 * i + 2 + i % 2);
+    }
+    check += set.size();
+  });
+  double appended = time_ms([&]{
+    Set set;
+    for(int i = 0 ; i < n ; ++i){
+      set.append(3 * i, 3 * i + 2 + i % 2);
+    }
+    check += set.size();
+  });
+  std::printf("%-16s n=%-9d insert %8.2f ms   hinted insert %8.2f ms (x%.2f)   append %8.2f ms (x%.2f)   [%zu]\n",
+    name, n, plain, hinted, plain / hinted, appended, plain / appended, check);
+}
+
+/**
+ * Apply bursts of small random inserts (and a few removes) between reads, directly and through a BufferedRangeSet.
+ */
+template <typename Set>
+void bench_bursts(const char * name, int bursts, int burst_size){
+  size_t check = 0;
+  auto && run = [&](auto & set){
+    unsigned x = 1;
+    for(int b = 0 ; b < bursts ; ++b){
+      for(int i = 0 ; i < burst_size ; ++i){
+        x = x * 1103515245 + 12345;
+        int start = static_cast<int>((x >> 4) % 10000000);
+        if(i % 8){
+          set.insert(start, start + 1 + static_cast<int>(x % 50));
+        }
+        else {
+          set.remove(start, start + 1 + static_cast<int>(x % 50));
+        }
+      }
+      check += set.contains(static_cast<int>(x % 10000000));
+    }
+    check += set.size();
+  };
+  double plain = time_ms([&]{
+    Set set;
+    run(set);
+  });
+  double buffered = time_ms([&]{
+    BufferedRangeSet<int, true, Set> set;
+    run(set);
+  });
+  std::printf("%-16s bursts=%-5d x %-6d direct %8.2f ms   buffered %8.2f ms (x%.2f)   [%zu]\n",
+    name, bursts, burst_size, plain, buffered, plain / buffered, check);
+}
+
+/**
+ * Look for holes of growing sizes in a fragmented address space (where only the end is free), with find_gap() and by walking the gaps.
+ */
+void bench_find_gap(int n){
+  RangeSet<uint64_t> space;
+  for(uint64_t i = 0 ; i < static_cast<uint64_t>(n) ; ++i){
+    space.append(4 * i, 4 * i + 3);
+  }
+  uint64_t check = 0;
+  double tree = time_ms([&]{
+    for(uint64_t len = 1 ; len <= 16 ; ++len){
+      check += space.find_gap(len, 0, 4 * n + 2000, RangeSetFit::first_fit)->first;
+    }
+  });
+  double walk = time_ms([&]{
+    for(uint64_t len = 1 ; len <= 16 ; ++len){
+      for(auto && g : space.gaps(0, 4 * n + 2000)){
+        if(g.second - g.first >= len){
+          check += g.first;
+          break;
+        }
+      }
+    }
+  });
+  std::printf("%-16s n=%-9d find_gap %8.2f ms   walk %8.2f ms (x%.2f)   [%llu]\n", "RangeSet", n, tree, walk, walk / tree, static_cast<unsigned long long>(check));
+}
+
+/**
+ * Look up values drifting slowly through the set (a random walk of steps of up to jump values) with find() and with a Cursor.
+ */
+template <typename Set>
+void bench_cursor(const char * name, int n, int jump){
+  Set set;
+  for(int i = 0 ; i < n ; ++i){
+    set.append(4 * i, 4 * i + 3);
+  }
+  const int lookups = 2000000;
+  size_t check = 0;
+  auto && run = [&](auto && find){
+    unsigned x = 1;
+    int v = 2 * n;
+    for(int i = 0 ; i < lookups ; ++i){
+      x = x * 1103515245 + 12345;
+      v = std::min(std::max(v + static_cast<int>((x >> 8) % (2 * jump + 1)) - jump, 0), 4 * n - 1);
+      check += find(v);
+    }
+  };
+  double plain = time_ms([&]{
+    run([&](int v){ return set.contains(v); });
+  });
+  double cursor = time_ms([&]{
+    auto && c = set.cursor();
+    run([&](int v){ return c.contains(v); });
+  });
+  std::printf("%-16s n=%-9d jump=%-6d find %8.2f ms   cursor %8.2f ms (x%.2f)   [%zu]\n",
+    name, n, jump, plain, cursor, plain / cursor, check);
+}
+
+/**
+ * Hand the upper half of a set over to another one and back, with split() / join() and by copying and removing the ranges.
+ */
+void bench_split(int n){
+  RangeSet<int> set;
+  for(int i = 0 ; i < n ; ++i){
+    set.append(4 * i, 4 * i + 3);
+  }
+  const int rounds = 10;
+  size_t check = 0;
+  double tree = time_ms([&]{
+    for(int r = 0 ; r < rounds ; ++r){
+      RangeSet<int> upper = set.split(2 * n + r);
+      check += upper.size();
+      set.join(std::move(upper));
+    }
+  });
+  double copy = time_ms([&]{
+    for(int r = 0 ; r < rounds ; ++r){
+      RangeSet<int> upper;
+      for(auto && it = set.lower_bound(2 * n + r) ; it != set.cend() ; ++it){
+        upper.append(std::max(it->first, 2 * n + r), it->second);
+      }
+      set.remove(2 * n + r, 4 * n);
+      check += upper.size();
+      for(auto && range : upper){
+        set.append(range.first, range.second);
+      }
+    }
+  });
+  std::printf("%-16s n=%-9d split+join %8.2f ms   copy+remove %8.2f ms (x%.2f)   [%zu]\n", "RangeSet", n, tree, copy, copy / tree, check);
+}
+
+/**
+ * Random point operations (insert, contains, remove) on n ranges. The std::set of ranges (inserted, looked up and erased without merging) is the red-black tree RangeSet used to be backed by, for reference.
+ */
+template <typename Set>
+void bench_point(const char * name, int n){
+  const int domain = 40 * n;
+  size_t check = 0;
+  Set set;
+  unsigned x = 1;
+  double insert = time_ms([&]{
+    for(int i = 0 ; i < n ; ++i){
+      x = x * 1103515245 + 12345;
+      int start = static_cast<int>((x >> 4) % domain);
+      set.insert(start, start + 1 + static_cast<int>(x % 7));
+    }
+  });
+  double find = time_ms([&]{
+    for(int i = 0 ; i < n ; ++i){
+      x = x * 1103515245 + 12345;
+      check += set.contains(static_cast<int>((x >> 4) % domain));
+    }
+  });
+  double remove = time_ms([&]{
+    for(int i = 0 ; i < n ; ++i){
+      x = x * 1103515245 + 12345;
+      int start = static_cast<int>((x >> 4) % domain);
+      set.remove(start, start + 1 + static_cast<int>(x % 7));
+    }
+  });
+  std::printf("%-16s n=%-9d insert %8.2f ms   contains %8.2f ms   remove %8.2f ms   [%zu]\n", name, n, insert, find, remove, check + set.size());
+}
+
+void bench_point_std_set(int n){
+  const int domain = 40 * n;
+  size_t check = 0;
+  std::set<std::pair<int, int>> set;
+  unsigned x = 1;
+  double insert = time_ms([&]{
+    for(int i = 0 ; i < n ; ++i){
+      x = x * 1103515245 + 12345;
+      int start = static_cast<int>((x >> 4) % domain);
+      set.emplace(start, start + 1 + static_cast<int>(x % 7));
+    }
+  });
+  double find = time_ms([&]{
+    for(int i = 0 ; i < n ; ++i){
+      x = x * 1103515245 + 12345;
+      int v = static_cast<int>((x >> 4) % domain);
+      auto && it = set.upper_bound({v, std::numeric_limits<int>::max()});
+      check += it != set.begin() && v < std::prev(it)->second;
+    }
+  });
+  double remove = time_ms([&]{
+    for(int i = 0 ; i < n ; ++i){
+      x = x * 1103515245 + 12345;
+      int start = static_cast<int>((x >> 4) % domain);
+      auto && it = set.lower_bound({start, std::numeric_limits<int>::min()});
+      if(it != set.end() && it->first == start){
+        set.erase(it);
+      }
+    }
+  });
+  std::printf("%-16s n=%-9d insert %8.2f ms   contains %8.2f ms   remove %8.2f ms   [%zu]\n", "std::set", n, insert, find, remove, check + set.size());
+}
+
+/**
+ * Random lookups in a FlatRangeSet of n integral ranges through each path of the membership kernel, and through std::partition_point for reference.
+ */
+void bench_kernel(int n){
+  using rangeset_detail::kernel_path;
+  const int queries = 10000000;
+  FlatRangeSet<int> set;
+  for(int i = 0 ; i < n ; ++i){
+    set.append(4 * i, 4 * i + 3);
+  }
+  auto && run = [&](auto && contains){
+    size_t check = 0;
+    unsigned x = 1;
+    double res = time_ms([&]{
+      for(int q = 0 ; q < queries ; ++q){
+        x = x * 1103515245 + 12345;
+        check += contains(static_cast<int>((x >> 4) % (4u * n)));
+      }
+    });
+    return std::make_pair(res, check);
+  };
+  auto && lookup = [&](int v){ return set.contains(v); };
+  rangeset_detail::kernel_override = kernel_path::scalar;
+  auto && scalar = run(lookup);
+  std::printf("kernel scalar     n=%-9d %8.2f ms   [%zu]\n", n, scalar.first, scalar.second);
+#ifdef RANGESET_SIMD_AVX2
+  if(rangeset_detail::cpu_has_avx2()){
+    rangeset_detail::kernel_override = kernel_path::avx2;
+    auto && avx2 = run(lookup);
+    std::printf("kernel avx2       n=%-9d %8.2f ms   [%zu]\n", n, avx2.first, avx2.second);
+  }
+#endif
+  rangeset_detail::kernel_override = kernel_path::automatic;
+  auto && partition = run([&](int v){
+    auto && it = std::partition_point(set.begin(), set.end(), [&](auto && r){ return r.first <= v; });
+    return it != set.begin() && v < std::prev(it)->second;
+  });
+  std::printf("partition_point   n=%-9d %8.2f ms   [%zu]\n", n, partition.first, partition.second);
+}
+
+/**
+ * Random lookups in n ranges, in a RangeSet, a FlatRangeSet and the FrozenRangeSet frozen from them.
+ */
+void bench_lookup(int n){
+  const int queries = 2000000;
+  RangeSet<int> tree;
+  FlatRangeSet<int> flat;
+  for(int i = 0 ; i < n ; ++i){
+    tree.append(4 * i, 4 * i + 3);
+    flat.append(4 * i, 4 * i + 3);
+  }
+  auto && frozen = flat.freeze();
+  auto && run = [&](const char * name, auto && set){
+    size_t check = 0;
+    unsigned x = 1;
+    double res = time_ms([&]{
+      for(int q = 0 ; q < queries ; ++q){
+        x = x * 1103515245 + 12345;
+        check += set.contains(static_cast<int>((x >> 4) % (4u * n)));
+      }
+    });
+    std::printf("lookup %-16s n=%-9d %8.2f ms   [%zu]\n", name, n, res, check);
+  };
+  run("RangeSet", tree);
+  run("FlatRangeSet", flat);
+  run("FrozenRangeSet", frozen);
+}
+
+int main(){
+  for(int n : {1000, 1000000, 8000000}){
+    bench_lookup(n);
+  }
+  for(int n : {1000, 100000, 4000000}){
+    bench_kernel(n);
+  }
+  for(int n : {100000, 1000000}){
+    bench_point<RangeSet<int>>("RangeSet", n);
+    bench_point<PooledRangeSet<int>>("PooledRangeSet", n);
+    bench_point_std_set(n);
+  }
+  for(int n : {10000, 100000, 1000000}){
+    bench_monotonic<RangeSet<int>>("RangeSet", n);
+    bench_monotonic<FlatRangeSet<int>>("FlatRangeSet", n);
+  }
+  for(int n : {10000, 100000, 1000000}){
+    bench_find_gap(n);
+  }
+  for(int burst_size : {100, 1000, 10000}){
+    bench_bursts<RangeSet<int>>("RangeSet", 100000 / burst_size, burst_size);
+    bench_bursts<FlatRangeSet<int>>("FlatRangeSet", 100000 / burst_size, burst_size);
+  }
+  for(int jump : {4, 64, 4096, 1000000}){
+    bench_cursor<RangeSet<int>>("RangeSet", 1000000, jump);
+    bench_cursor<FlatRangeSet<int>>("FlatRangeSet", 1000000, jump);
+  }
+  for(int n : {10000, 100000, 1000000}){
+    bench_split(n);
+  }
+}
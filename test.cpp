@@ -1,4 +1,9 @@
+#include <cstdint>
 #include <initializer_list>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <string_view>
 #include <vector>
 #define private public
 #define protected public
@@ -8,22 +13,18 @@
 
 #include <ostream>
 
-template <typename T, bool B>
-inline std::ostream& _helper1 ( std::ostream& os, typename RangeSet<T, B>::const_iterator const& it ) {
-  if(it.lower == it.end){
-    return os << "{END iterator}";
-  }
-  else {
-    return os << "(" << it->first << ", " << it->second << ")";
-  }
+// Iterators do not know if they are past-the-end, so they can't be dereferenced for printing.
+std::ostream& operator<< ( std::ostream& os, typename RangeSet<int, true>::const_iterator const& ) {
+  return os << "{RangeSet iterator}";
 }
-
-
-std::ostream& operator<< ( std::ostream& os, typename RangeSet<int, true>::const_iterator const& it ) {
-  return _helper1<int, true>(os, it);
+std::ostream& operator<< ( std::ostream& os, typename RangeSet<int, false>::const_iterator const& ) {
+  return os << "{RangeSet iterator}";
+}
+std::ostream& operator<< ( std::ostream& os, typename FlatRangeSet<int, true>::const_iterator const& ) {
+  return os << "{FlatRangeSet iterator}";
 }
-std::ostream& operator<< ( std::ostream& os, typename RangeSet<int, false>::const_iterator const& it ) {
-  return _helper1<int, false>(os, it);
+std::ostream& operator<< ( std::ostream& os, typename FlatRangeSet<int, false>::const_iterator const& ) {
+  return os << "{FlatRangeSet iterator}";
 }
 
 
@@ -35,8 +36,8 @@ std::ostream& operator<< ( std::ostream& os, typename RangeSet<int, false>::cons
 
 namespace test_rangeset{
 
-template <typename T, bool B>
-void assert_rangeset_equals(const std::initializer_list<std::pair<T, T> > & expected, const RangeSet<T, B> & set){
+template <typename Set>
+void assert_rangeset_equals(const std::initializer_list<typename Set::const_iterator::value_type> & expected, const Set & set){
   REQUIRE(expected.size() == set.size());
   auto && it1 = expected.begin(), end1 = expected.end();
   auto && it2 = set.cbegin(), end2 = set.cend();
@@ -46,16 +47,21 @@ void assert_rangeset_equals(const std::initializer_list<std::pair<T, T> > & expe
   }
 }
 
-template <typename T, bool B>
-void assert_state(const RangeSet<T, B> & set){
-  REQUIRE(set.data.size() % 2 == 0 );
-  if(set.data.size() % 2){
-    return;
-  }
+template <typename Set>
+void assert_rangesets_equal(const Set & expected, const Set & set){
+  REQUIRE(expected.size() == set.size());
+  REQUIRE(std::equal(expected.cbegin(), expected.cend(), set.cbegin()));
+}
+
+template <template <typename, bool, typename, typename> class Set, typename T, bool B, typename C, typename A>
+void assert_state(const Set<T, B, C, A> & set){
+  auto && comp = set.key_comp();
   auto && it = set.data.begin(), end = set.data.end();
-  while(it != end) {
-    REQUIRE((int) it++->dir == (int) RangeSet<T, B>::end_point_t::LOWER);
-    REQUIRE((int) it++->dir == (int) RangeSet<T, B>::end_point_t::UPPER);
+  for(; it != end ; ++it) {
+    REQUIRE(comp(it->first, it->second));
+    if(it != set.data.begin()){
+      REQUIRE((B ? comp(std::prev(it)->second, it->first) : !comp(it->first, std::prev(it)->second)));
+    }
   }
 }
 
@@ -344,8 +350,8 @@ static constexpr param_t keep_touching[] = {
   },
 };
 
-template<typename T, bool B>
-static void test(const param_t & param, RangeSet<T, B> & set){
+template<typename Set>
+static void test(const param_t & param, Set & set){
   for(auto && p:param.inserted){
     set.insert(p);
   }
@@ -843,8 +849,8 @@ static constexpr param_t three_ranges[] = {
   },
 };
 
-template<typename T, bool B>
-static void test(const param_t & param, RangeSet<T, B> & set){
+template<typename Set>
+static void test(const param_t & param, Set & set){
   for(auto && p:param.inserted){
     set.insert(p);
   }
@@ -991,16 +997,19 @@ DECLARE_DATA_CASE(three_ranges) {
   
 };
 
-template<typename T, bool B>
-DATA_CASE_TEST(PARAM_TYPE param, RangeSet<T, B> & set){
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
   for(auto && p:param.inserted){
     set.insert(p);
   }
+  auto && frozen = set.freeze();
   if(param.expected.first == -1){
     REQUIRE(set.find(param.searched) == set.cend());
+    REQUIRE(frozen.find(param.searched) == frozen.cend());
   }
   else {
     REQUIRE(*set.find(param.searched) == param.expected);
+    REQUIRE(*frozen.find(param.searched) == param.expected);
   }
 }
 
@@ -1236,16 +1245,19 @@ DECLARE_DATA_CASE(three_ranges) {
   },
 };
 
-template<typename T, bool B>
-DATA_CASE_TEST(PARAM_TYPE param, RangeSet<T, B> & set){
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
   for(auto && p:param.inserted){
     set.insert(p);
   }
+  auto && frozen = set.freeze();
   if(param.expected.first == -1){
     REQUIRE(set.find(param.searched) == set.cend());
+    REQUIRE(frozen.find(param.searched) == frozen.cend());
   }
   else {
     REQUIRE(*set.find(param.searched) == param.expected);
+    REQUIRE(*frozen.find(param.searched) == param.expected);
   }
 }
 
@@ -1310,8 +1322,8 @@ DECLARE_DATA_CASE(simple) {
 };
 
 
-template<typename T, bool B>
-DATA_CASE_TEST(PARAM_TYPE param, RangeSet<T, B> & set){
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
   for(auto && p:param.inserted){
     set.insert(p);
   }
@@ -1429,8 +1441,8 @@ DECLARE_DATA_CASE(three_ranges) {
 
 
 
-template<typename T, bool B>
-DATA_CASE_TEST(PARAM_TYPE param, RangeSet<T, B> & set){
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
   for(auto && p:param.inserted){
     set.insert(p);
   }
@@ -1453,199 +1465,1639 @@ DATA_CASE_TEST(PARAM_TYPE param, RangeSet<T, B> & set){
 
 
 
-TEST_CASE("rangeset merge touching"){
-  RangeSet<int> set;
-  BEGIN_PARAMS_SECTION(insert)
-    // Tests insert(pair), insert(start, end), const_iterator, cbegin, cend, size, 
-    DATA_CASE(simple, set)
-    DATA_CASE(common, set)
-    DATA_CASE(merge_touching, set)
-  END
+DECLARE_PARAMS_SECTION(assign_sorted){
 
-  BEGIN_PARAMS_SECTION(remove)
-    // Tests remove(pair), remove(start, end) 
-    DATA_CASE(trivial, set)
-    DATA_CASE(one_range, set)
-    DATA_CASE(three_ranges, set)
-  END
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > input;
+  const std::initializer_list<std::pair<int, int> > expected;
+};
 
-  BEGIN_PARAMS_SECTION(find1)
-    // Tests find(val)
-    DATA_CASE(simple, set)
-    DATA_CASE(three_ranges, set)
-  END
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty is empty",
+    {},
+    {},
+    {}
+  },
+  {
+    "Replace by empty",
+    {{10, 20}},
+    {},
+    {}
+  },
+  {
+    "One",
+    {},
+    {{10, 20}},
+    {{10, 20}}
+  },
+  {
+    "Three replace",
+    {{5, 8}, {15, 55}},
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{10, 20}, {30, 40}, {50, 60}},
+  },
+};
 
-  BEGIN_PARAMS_SECTION(find2)
-    // Tests find(start, end), find(pair)
-    DATA_CASE(simple, set)
-    DATA_CASE(three_ranges, set)
-  END
-  
-  BEGIN_PARAMS_SECTION(erase1)
-    // Tests erase(it)
-    DATA_CASE(simple, set)
-  END
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching",
+    {},
+    {{10, 20}, {20, 30}, {40, 50}},
+    {{10, 20}, {20, 30}, {40, 50}},
+  },
+};
 
-  BEGIN_PARAMS_SECTION(erase2)
-    // Tests erase(it1, it2)
-    DATA_CASE(simple, set)
-    DATA_CASE(three_ranges, set)
-  END
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  Set set2{set};
+  set.assign_sorted(param.input.begin(), param.input.end());
+  assert_state(set);
+  assert_rangeset_equals(param.expected, set);
+  set2.assign_sorted_checked(param.input.begin(), param.input.end());
+  assert_state(set2);
+  assert_rangeset_equals(param.expected, set2);
 }
 
-TEST_CASE("rangeset keep touching"){
-  RangeSet<int, false> set;
-  BEGIN_PARAMS_SECTION(insert)
-    // Tests insert(pair), insert(start, end), const_iterator, cbegin, cend, size, 
-    DATA_CASE(simple, set)
-    DATA_CASE(common, set)
-    DATA_CASE(keep_touching, set)
-  END
+};
 
-  BEGIN_PARAMS_SECTION(remove)
-    // Tests remove(pair), remove(start, end) 
-    DATA_CASE(trivial, set)
-    DATA_CASE(one_range, set)
-    DATA_CASE(three_ranges, set)
-  END
+DECLARE_PARAMS_SECTION(assign_checked_invalid){
 
-  BEGIN_PARAMS_SECTION(find1)
-    // Tests find(val)
-    DATA_CASE(simple, set)
-    DATA_CASE(three_ranges, set)
-  END
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > input;
+};
 
-  BEGIN_PARAMS_SECTION(find2)
-    // Tests find(start, end), find(pair)
-    DATA_CASE(simple, set)
-    DATA_CASE(three_ranges, set)
-  END
-  
-  BEGIN_PARAMS_SECTION(erase1)
-    // Tests erase(it)
-    DATA_CASE(simple, set)
-  END
-  
-  BEGIN_PARAMS_SECTION(erase2)
-    // Tests erase(it1, it2)
-    DATA_CASE(simple, set)
-    DATA_CASE(three_ranges, set)
-  END
-}
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty range",
+    {{10, 20}},
+    {{30, 30}},
+  },
+  {
+    "Reversed range",
+    {{10, 20}},
+    {{40, 30}},
+  },
+  {
+    "Unsorted",
+    {{10, 20}},
+    {{30, 40}, {10, 20}},
+  },
+  {
+    "Overlapping",
+    {},
+    {{10, 30}, {20, 40}},
+  },
+  {
+    "Last overlapping",
+    {{10, 20}},
+    {{30, 40}, {50, 60}, {55, 70}},
+  },
+};
 
+DECLARE_DATA_CASE(merge_touching) {
+  {
+    "Touching",
+    {{10, 20}},
+    {{30, 40}, {40, 50}},
+  },
+};
 
-TEST_CASE("(old test cases) rangeset merge touching insert2"){
-  RangeSet<int> set{};
-  assert_state(set);
-  assert_rangeset_equals({}, set);
-  set.insert(10, 20);
-  assert_state(set);
-  assert_rangeset_equals({
-    {10, 20},
-  }, set);
-  
-  set.insert(30, 40);
-  assert_state(set);
-  assert_rangeset_equals({
-    {10, 20},
-    {30, 40},
-  }, set);
-  
-  set.insert(50, 60);
-  set.insert(70, 80);
-  set.insert(90, 100);
-  
-  assert_state(set);
-  assert_rangeset_equals({
-    {10, 20},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 100},
-  }, set);
-  
-  set.insert(30, 40);
-  assert_state(set);
-  assert_rangeset_equals({
-    {10, 20},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 100},
-  }, set);
-  
-  set.insert(8, 10);
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  REQUIRE_THROWS_AS(set.assign_sorted_checked(param.input.begin(), param.input.end()), std::invalid_argument);
   assert_state(set);
-  assert_rangeset_equals({
-    {8, 20},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 100},
-  }, set);
+  assert_rangeset_equals(param.inserted, set);
+}
 
-  set.insert(6, 10);
-  assert_state(set);
-  assert_rangeset_equals({
-    {6, 20},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 100},
-  }, set);
-  
-  set.insert(5, 22);
-  assert_state(set);
-  assert_rangeset_equals({
-    {5, 22},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 100},
-  }, set);
-  
-  set.insert(100, 105);
-  assert_state(set);
-  assert_rangeset_equals({
-    {5, 22},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 105},
-  }, set);
-  
-  set.insert(100, 107);
-  assert_state(set);
-  assert_rangeset_equals({
-    {5, 22},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {90, 107},
-  }, set);
+};
 
-  set.insert(88, 110);
-  assert_state(set);
-  assert_rangeset_equals({
-    {5, 22},
-    {30, 40},
-    {50, 60},
-    {70, 80},
-    {88, 110},
-  }, set);
-  
-  set.insert(22, 30);
-  assert_state(set);
-  assert_rangeset_equals({
-    {5, 40},
-    {50, 60},
-    {70, 80},
-    {88, 110},
-  }, set);
-  
-  set.insert(20, 55);
-  assert_state(set);
-  assert_rangeset_equals({
+DECLARE_PARAMS_SECTION(assign_coalesce){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > input;
+  const std::initializer_list<std::pair<int, int> > expected;
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Replace by empty",
+    {{10, 20}},
+    {},
+    {}
+  },
+  {
+    "Skip empty",
+    {},
+    {{5, 5}, {10, 20}, {25, 25}, {30, 40}, {45, 45}},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Only empty",
+    {{10, 20}},
+    {{5, 5}, {25, 25}},
+    {},
+  },
+  {
+    "Overlap",
+    {},
+    {{10, 20}, {15, 30}, {25, 28}, {40, 50}},
+    {{10, 30}, {40, 50}},
+  },
+  {
+    "Same start",
+    {},
+    {{10, 20}, {10, 30}},
+    {{10, 30}},
+  },
+  {
+    "Contained",
+    {{5, 8}},
+    {{10, 40}, {20, 30}, {35, 50}},
+    {{10, 50}},
+  },
+};
+
+DECLARE_DATA_CASE(merge_touching) {
+  {
+    "Touching",
+    {},
+    {{10, 20}, {20, 30}, {40, 50}},
+    {{10, 30}, {40, 50}},
+  },
+};
+
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching",
+    {},
+    {{10, 20}, {20, 30}, {30, 40}},
+    {{10, 20}, {20, 30}, {30, 40}},
+  },
+  {
+    "Overlap then touching",
+    {},
+    {{10, 20}, {15, 25}, {25, 30}},
+    {{10, 25}, {25, 30}},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  set.assign_sorted_coalesce(param.input.begin(), param.input.end());
+  assert_state(set);
+  assert_rangeset_equals(param.expected, set);
+}
+
+};
+
+
+
+
+
+DECLARE_PARAMS_SECTION(insert_many){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > batch; // Expected result is the same as inserting one by one
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty batch",
+    {{10, 20}},
+    {},
+  },
+  {
+    "Empty batch to empty",
+    {},
+    {},
+  },
+  {
+    "Only empty ranges",
+    {{10, 20}},
+    {{5, 5}, {30, 25}},
+  },
+  {
+    "Unsorted to empty",
+    {},
+    {{50, 60}, {10, 20}, {30, 40}},
+  },
+  {
+    "Overlapping batch",
+    {},
+    {{50, 60}, {15, 35}, {10, 20}, {30, 40}, {55, 58}},
+  },
+  {
+    "Touching batch",
+    {},
+    {{20, 30}, {10, 20}, {30, 40}, {50, 60}},
+  },
+  {
+    "Interleaved",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{62, 65}, {22, 25}, {2, 8}, {42, 45}},
+  },
+  {
+    "Touching existing",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{40, 50}, {20, 30}, {60, 62}, {8, 10}},
+  },
+  {
+    "Overlapping existing",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{39, 51}, {5, 11}, {15, 18}, {58, 70}},
+  },
+  {
+    "Cover all",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{25, 45}, {5, 65}},
+  },
+  {
+    "One range, many merged",
+    {{10, 20}, {20, 30}, {30, 40}, {50, 60}},
+    {{15, 55}},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  Set expected{set};
+  for(auto && p:param.batch){
+    expected.insert(p);
+  }
+  set.insert_many(param.batch.begin(), param.batch.end());
+  assert_state(set);
+  assert_rangesets_equal(expected, set);
+}
+
+};
+
+DECLARE_PARAMS_SECTION(insert_many_large){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const int existing; // Number of existing ranges [10i, 10i+4)
+  const int batch; // Number of inserted ranges [(7j)%100 * 10 + 3, + 9), out of order
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Small batch in large set",
+    1000,
+    10,
+  },
+  {
+    "Large batch in small set",
+    10,
+    1000,
+  },
+  {
+    "Same size",
+    100,
+    100,
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(int i = 0 ; i < param.existing ; ++i){
+    set.insert(10 * i, 10 * i + 4);
+  }
+  std::vector<std::pair<int, int>> batch;
+  for(int j = 0 ; j < param.batch ; ++j){
+    int start = (7 * j) % param.batch * 10 + 3 + (j % 3);
+    batch.emplace_back(start, start + 9 - (j % 5) * 2);
+  }
+  Set expected{set};
+  for(auto && p:batch){
+    expected.insert(p);
+  }
+  set.insert_many(batch.begin(), batch.end());
+  assert_state(set);
+  assert_rangesets_equal(expected, set);
+}
+
+};
+
+
+
+
+
+DECLARE_PARAMS_SECTION(unite){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > other;
+  const std::initializer_list<std::pair<int, int> > expected;
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty | Empty",
+    {},
+    {},
+    {},
+  },
+  {
+    "Empty | Set",
+    {},
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Set | Empty",
+    {{10, 20}, {30, 40}},
+    {},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Same",
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Interleaved",
+    {{10, 20}, {50, 60}},
+    {{2, 8}, {30, 40}, {70, 80}},
+    {{2, 8}, {10, 20}, {30, 40}, {50, 60}, {70, 80}},
+  },
+  {
+    "Overlapping",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{15, 35}, {38, 52}, {58, 70}},
+    {{10, 70}},
+  },
+  {
+    "Contained",
+    {{10, 60}},
+    {{15, 20}, {30, 40}},
+    {{10, 60}},
+  },
+  {
+    "Containing",
+    {{15, 20}, {30, 40}},
+    {{10, 60}},
+    {{10, 60}},
+  },
+};
+
+DECLARE_DATA_CASE(merge_touching) {
+  {
+    "Touching",
+    {{10, 20}, {40, 50}},
+    {{20, 30}, {50, 60}},
+    {{10, 30}, {40, 60}},
+  },
+};
+
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching",
+    {{10, 20}, {40, 50}},
+    {{20, 30}, {50, 60}},
+    {{10, 20}, {20, 30}, {40, 50}, {50, 60}},
+  },
+  {
+    "Touching both sides",
+    {{10, 20}, {20, 30}},
+    {{15, 25}},
+    {{10, 30}},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  Set oth;
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  for(auto && p:param.other){
+    oth.insert(p);
+  }
+  Set expected;
+  for(auto && p:param.expected){
+    expected.insert(p);
+  }
+  REQUIRE((set | oth) == expected);
+  REQUIRE((oth | set) == expected);
+  Set set2{set};
+  set2.unite(set2);
+  REQUIRE(set2 == set);
+  set2 |= oth;
+  REQUIRE(set2 == expected);
+  set.unite(oth);
+  assert_state(set);
+  assert_rangeset_equals(param.expected, set);
+}
+
+};
+
+
+
+
+
+DECLARE_PARAMS_SECTION(intersect){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > other;
+  const std::initializer_list<std::pair<int, int> > expected;
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty & Empty",
+    {},
+    {},
+    {},
+  },
+  {
+    "Empty & Set",
+    {},
+    {{10, 20}, {30, 40}},
+    {},
+  },
+  {
+    "Set & Empty",
+    {{10, 20}, {30, 40}},
+    {},
+    {},
+  },
+  {
+    "Same",
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Disjoint",
+    {{10, 20}, {50, 60}},
+    {{2, 8}, {30, 40}, {70, 80}},
+    {},
+  },
+  {
+    "Overlapping",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{15, 35}, {38, 52}, {58, 70}},
+    {{15, 20}, {30, 35}, {38, 40}, {50, 52}, {58, 60}},
+  },
+  {
+    "Contained",
+    {{10, 60}},
+    {{15, 20}, {30, 40}},
+    {{15, 20}, {30, 40}},
+  },
+  {
+    "Containing",
+    {{15, 20}, {30, 40}},
+    {{10, 60}},
+    {{15, 20}, {30, 40}},
+  },
+  {
+    "Partial",
+    {{10, 20}, {30, 40}, {50, 60}, {70, 80}},
+    {{35, 55}},
+    {{35, 40}, {50, 55}},
+  },
+};
+
+DECLARE_DATA_CASE(merge_touching) {
+  {
+    "Touching",
+    {{10, 20}, {40, 50}},
+    {{20, 30}, {50, 60}},
+    {},
+  },
+};
+
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching",
+    {{10, 20}, {40, 50}},
+    {{20, 30}, {50, 60}},
+    {},
+  },
+  {
+    "Split touching",
+    {{10, 20}, {20, 30}},
+    {{15, 25}},
+    {{15, 20}, {20, 25}},
+  },
+  {
+    "Touching pieces",
+    {{10, 30}},
+    {{12, 20}, {20, 25}},
+    {{12, 20}, {20, 25}},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  Set oth;
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  for(auto && p:param.other){
+    oth.insert(p);
+  }
+  Set expected;
+  expected.assign_sorted(param.expected.begin(), param.expected.end());
+  REQUIRE((set & oth) == expected);
+  REQUIRE((oth & set) == expected);
+  Set set2{set};
+  set2.intersect(set2);
+  REQUIRE(set2 == set);
+  set2 &= oth;
+  REQUIRE(set2 == expected);
+  oth.intersect(set);
+  assert_state(oth);
+  REQUIRE(oth == expected);
+  set.intersect(oth);
+  assert_state(set);
+  assert_rangeset_equals(param.expected, set);
+}
+
+};
+
+DECLARE_PARAMS_SECTION(intersect_large){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const int size1; // Number of ranges [10i, 10i+6)
+  const int size2; // Number of ranges [(37j)%size2 * 10 + 4, + 5)
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Small & Large",
+    10,
+    1000,
+  },
+  {
+    "Large & Small",
+    1000,
+    10,
+  },
+  {
+    "Same size",
+    100,
+    100,
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  Set oth;
+  for(int i = 0 ; i < param.size1 ; ++i){
+    set.insert(10 * i, 10 * i + 6);
+  }
+  for(int j = 0 ; j < param.size2 ; ++j){
+    int start = (37 * j) % param.size2 * 10 + 4;
+    oth.insert(start, start + 5);
+  }
+  Set expected{set};
+  for(int i = 0 ; i < param.size1 + param.size2 ; ++i){
+    if(oth.find(10 * i) == oth.cend()){
+      expected.remove(10 * i, 10 * i + 4);
+    }
+    if(oth.find(10 * i + 4) == oth.cend()){
+      expected.remove(10 * i + 4, 10 * i + 10);
+    }
+  }
+  REQUIRE((set & oth) == expected);
+  set &= oth;
+  assert_state(set);
+  assert_rangesets_equal(expected, set);
+}
+
+};
+
+
+
+
+
+DECLARE_PARAMS_SECTION(subtract){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<std::pair<int, int> > other;
+  const std::initializer_list<std::pair<int, int> > expected_difference;
+  const std::initializer_list<std::pair<int, int> > expected_symmetric;
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty - Empty",
+    {},
+    {},
+    {},
+    {},
+  },
+  {
+    "Empty - Set",
+    {},
+    {{10, 20}, {30, 40}},
+    {},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Set - Empty",
+    {{10, 20}, {30, 40}},
+    {},
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+  },
+  {
+    "Same",
+    {{10, 20}, {30, 40}},
+    {{10, 20}, {30, 40}},
+    {},
+    {},
+  },
+  {
+    "Disjoint",
+    {{10, 20}, {50, 60}},
+    {{2, 8}, {30, 40}, {70, 80}},
+    {{10, 20}, {50, 60}},
+    {{2, 8}, {10, 20}, {30, 40}, {50, 60}, {70, 80}},
+  },
+  {
+    "Overlapping",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {{15, 35}, {38, 52}, {58, 70}},
+    {{10, 15}, {35, 38}, {52, 58}},
+    {{10, 15}, {20, 30}, {35, 38}, {40, 50}, {52, 58}, {60, 70}},
+  },
+  {
+    "Holes",
+    {{10, 60}},
+    {{15, 20}, {30, 40}},
+    {{10, 15}, {20, 30}, {40, 60}},
+    {{10, 15}, {20, 30}, {40, 60}},
+  },
+  {
+    "Covered",
+    {{15, 20}, {30, 40}},
+    {{10, 60}},
+    {},
+    {{10, 15}, {20, 30}, {40, 60}},
+  },
+  {
+    "Exact bounds",
+    {{10, 20}, {30, 40}},
+    {{10, 12}, {18, 20}, {30, 32}, {38, 40}},
+    {{12, 18}, {32, 38}},
+    {{12, 18}, {32, 38}},
+  },
+};
+
+DECLARE_DATA_CASE(merge_touching) {
+  {
+    "Touching",
+    {{10, 20}, {40, 50}},
+    {{20, 30}, {50, 60}},
+    {{10, 20}, {40, 50}},
+    {{10, 30}, {40, 60}},
+  },
+};
+
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching",
+    {{10, 20}, {40, 50}},
+    {{20, 30}, {50, 60}},
+    {{10, 20}, {40, 50}},
+    {{10, 20}, {20, 30}, {40, 50}, {50, 60}},
+  },
+  {
+    "Touching subtrahend",
+    {{10, 30}},
+    {{12, 20}, {20, 25}},
+    {{10, 12}, {25, 30}},
+    {{10, 12}, {25, 30}},
+  },
+  {
+    "Touching ranges",
+    {{10, 20}, {20, 30}},
+    {{15, 25}},
+    {{10, 15}, {25, 30}},
+    {{10, 15}, {25, 30}},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  Set oth;
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  for(auto && p:param.other){
+    oth.insert(p);
+  }
+  Set difference, symmetric;
+  difference.assign_sorted(param.expected_difference.begin(), param.expected_difference.end());
+  symmetric.assign_sorted(param.expected_symmetric.begin(), param.expected_symmetric.end());
+  REQUIRE((set - oth) == difference);
+  REQUIRE((set ^ oth) == symmetric);
+  REQUIRE((oth ^ set) == symmetric);
+  Set set2{set};
+  set2 ^= oth;
+  REQUIRE(set2 == symmetric);
+  set2 = set;
+  set2 -= set2;
+  REQUIRE(set2.size() == 0);
+  set2 = set;
+  set2.subtract(param.other.begin(), param.other.end());
+  assert_state(set2);
+  REQUIRE(set2 == difference);
+  set -= oth;
+  assert_state(set);
+  assert_rangeset_equals(param.expected_difference, set);
+}
+
+};
+
+DECLARE_PARAMS_SECTION(subtract_large){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const int size1; // Number of ranges [10i, 10i+6)
+  const int size2; // Number of ranges [(37j)%size2 * 10 + 4, + 5)
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Small - Large",
+    10,
+    1000,
+  },
+  {
+    "Large - Small",
+    1000,
+    10,
+  },
+  {
+    "Same size",
+    100,
+    100,
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  Set oth;
+  for(int i = 0 ; i < param.size1 ; ++i){
+    set.insert(10 * i, 10 * i + 6);
+  }
+  for(int j = 0 ; j < param.size2 ; ++j){
+    int start = (37 * j) % param.size2 * 10 + 4;
+    oth.insert(start, start + 5);
+  }
+  Set expected{set};
+  for(auto && it = oth.cbegin() ; it != oth.cend() ; ++it){
+    expected.remove(*it);
+  }
+  REQUIRE((set - oth) == expected);
+  set -= oth;
+  assert_state(set);
+  assert_rangesets_equal(expected, set);
+}
+
+};
+
+
+
+
+
+DECLARE_PARAMS_SECTION(gaps){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::pair<int, int> window;
+  const std::initializer_list<std::pair<int, int> > expected;
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Empty set",
+    {},
+    {10, 20},
+    {{10, 20}},
+  },
+  {
+    "Empty window",
+    {{10, 20}},
+    {30, 30},
+    {},
+  },
+  {
+    "Window before",
+    {{10, 20}, {30, 40}},
+    {2, 8},
+    {{2, 8}},
+  },
+  {
+    "Window after",
+    {{10, 20}, {30, 40}},
+    {45, 50},
+    {{45, 50}},
+  },
+  {
+    "Window inside a range",
+    {{10, 20}, {30, 40}},
+    {12, 18},
+    {},
+  },
+  {
+    "Window in a gap",
+    {{10, 20}, {30, 40}},
+    {22, 28},
+    {{22, 28}},
+  },
+  {
+    "Window covering all",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {0, 70},
+    {{0, 10}, {20, 30}, {40, 50}, {60, 70}},
+  },
+  {
+    "Window on bounds",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {10, 60},
+    {{20, 30}, {40, 50}},
+  },
+  {
+    "Window starting and ending in ranges",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {15, 55},
+    {{20, 30}, {40, 50}},
+  },
+  {
+    "Window ending on a lower bound",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {25, 30},
+    {{25, 30}},
+  },
+  {
+    "Window starting on an upper bound",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {40, 45},
+    {{40, 45}},
+  },
+};
+
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching ranges have no gap",
+    {{10, 20}, {20, 30}, {40, 50}},
+    {5, 55},
+    {{5, 10}, {30, 40}, {50, 55}},
+  },
+  {
+    "Window starting in touching ranges",
+    {{10, 20}, {20, 30}, {40, 50}},
+    {20, 45},
+    {{30, 40}},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  auto && view = set.gaps(param.window.first, param.window.second);
+  std::vector<std::pair<int, int>> gaps;
+  for(auto && it = view.begin() ; it != view.end() ; it++){
+    gaps.push_back(*it);
+  }
+  REQUIRE(gaps == std::vector<std::pair<int, int>>(param.expected));
+  auto && complement = set.complement(param.window.first, param.window.second);
+  assert_state(complement);
+  assert_rangeset_equals(param.expected, complement);
+  // Same as inserting the window and removing the set
+  Set expected;
+  expected.insert(param.window);
+  expected.subtract(set.cbegin(), set.cend());
+  REQUIRE(complement == expected);
+}
+
+};
+
+
+
+
+
+DECLARE_PARAMS_SECTION(find_many){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const std::initializer_list<std::pair<int, int> > inserted;
+  const std::initializer_list<int> searched;
+  const std::initializer_list<int> expected; // -1 = npos
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Nothing searched",
+    {{10, 20}},
+    {},
+    {},
+  },
+  {
+    "Empty set",
+    {},
+    {5, 10, 15},
+    {-1, -1, -1},
+  },
+  {
+    "Sorted",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {5, 10, 15, 19, 20, 25, 30, 30, 45, 59, 60, 70},
+    {-1, 0, 0, 0, -1, -1, 1, 1, -1, 2, -1, -1},
+  },
+  {
+    "Unsorted",
+    {{10, 20}, {30, 40}, {50, 60}},
+    {59, 5, 30, 20, 10, 45, 15, 70, 30},
+    {2, -1, 1, -1, 0, -1, 0, -1, 1},
+  },
+};
+
+DECLARE_DATA_CASE(keep_touching) {
+  {
+    "Touching",
+    {{10, 20}, {20, 30}},
+    {10, 19, 20, 29, 30},
+    {0, 0, 1, 1, -1},
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(auto && p:param.inserted){
+    set.insert(p);
+  }
+  std::vector<size_t> indices;
+  set.find_many(param.searched.begin(), param.searched.end(), std::back_inserter(indices));
+  std::vector<bool> contained;
+  set.contains_many(param.searched.begin(), param.searched.end(), std::back_inserter(contained));
+  REQUIRE(indices.size() == param.expected.size());
+  REQUIRE(contained.size() == param.expected.size());
+  auto && it = param.expected.begin();
+  for(size_t i = 0 ; i < indices.size() ; ++i, ++it){
+    REQUIRE(indices[i] == (*it == -1 ? Set::npos : static_cast<size_t>(*it)));
+    REQUIRE(contained[i] == (*it != -1));
+  }
+}
+
+};
+
+DECLARE_PARAMS_SECTION(find_many_large){
+
+DECLARE_PARAM_TYPE{
+  const char * name;
+  const int ranges; // Number of ranges [10i, 10i+6)
+  const int searched; // Number of searched values
+  const bool sorted;
+};
+
+DECLARE_DATA_CASE(common) {
+  {
+    "Few sorted values",
+    1000,
+    10,
+    true,
+  },
+  {
+    "Few unsorted values",
+    1000,
+    10,
+    false,
+  },
+  {
+    "Many sorted values",
+    10,
+    1000,
+    true,
+  },
+  {
+    "Many unsorted values",
+    10,
+    1000,
+    false,
+  },
+};
+
+template<typename Set>
+DATA_CASE_TEST(PARAM_TYPE param, Set & set){
+  for(int i = 0 ; i < param.ranges ; ++i){
+    set.insert(10 * i, 10 * i + 6);
+  }
+  std::vector<int> values;
+  for(int j = 0 ; j < param.searched ; ++j){
+    values.push_back(param.sorted ? j * 7 : (j * 37) % param.searched * 7);
+  }
+  std::vector<size_t> indices;
+  set.find_many(values.begin(), values.end(), std::back_inserter(indices));
+  std::vector<bool> contained;
+  set.contains_many(values.begin(), values.end(), std::back_inserter(contained));
+  for(size_t j = 0 ; j < values.size() ; ++j){
+    auto && it = set.find(values[j]);
+    REQUIRE(contained[j] == (it != set.cend()));
+    REQUIRE(indices[j] == (it == set.cend() ? Set::npos : static_cast<size_t>(std::distance(set.cbegin(), it))));
+  }
+}
+
+};
+
+
+
+
+
+TEST_CASE("rangeset merge touching"){
+  RangeSet<int> set;
+  BEGIN_PARAMS_SECTION(insert)
+    // Tests insert(pair), insert(start, end), const_iterator, cbegin, cend, size, 
+    DATA_CASE(simple, set)
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(remove)
+    // Tests remove(pair), remove(start, end) 
+    DATA_CASE(trivial, set)
+    DATA_CASE(one_range, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find1)
+    // Tests find(val)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find2)
+    // Tests find(start, end), find(pair)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+  
+  BEGIN_PARAMS_SECTION(erase1)
+    // Tests erase(it)
+    DATA_CASE(simple, set)
+  END
+
+  BEGIN_PARAMS_SECTION(erase2)
+    // Tests erase(it1, it2)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_sorted)
+    // Tests assign_sorted(first, last), assign_sorted_checked(first, last)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_checked_invalid)
+    // Tests assign_sorted_checked(first, last) errors
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_coalesce)
+    // Tests assign_sorted_coalesce(first, last)
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many)
+    // Tests insert_many(first, last)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many_large)
+    // Tests insert_many(first, last) lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(unite)
+    // Tests unite(), operator|, operator|=, operator==
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect)
+    // Tests intersect(), operator&, operator&=
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect_large)
+    // Tests intersect(), operator& lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract)
+    // Tests subtract(), subtract(first, last), operator-, operator-=, operator^, operator^=
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract_large)
+    // Tests subtract(), operator- lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(gaps)
+    // Tests gaps(lo, hi), complement(lo, hi)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many)
+    // Tests find_many(first, last, out), contains_many(first, last, out)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many_large)
+    // Tests find_many(first, last, out), contains_many(first, last, out) strategies
+    DATA_CASE(common, set)
+  END
+}
+
+TEST_CASE("rangeset keep touching"){
+  RangeSet<int, false> set;
+  BEGIN_PARAMS_SECTION(insert)
+    // Tests insert(pair), insert(start, end), const_iterator, cbegin, cend, size, 
+    DATA_CASE(simple, set)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(remove)
+    // Tests remove(pair), remove(start, end) 
+    DATA_CASE(trivial, set)
+    DATA_CASE(one_range, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find1)
+    // Tests find(val)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find2)
+    // Tests find(start, end), find(pair)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+  
+  BEGIN_PARAMS_SECTION(erase1)
+    // Tests erase(it)
+    DATA_CASE(simple, set)
+  END
+  
+  BEGIN_PARAMS_SECTION(erase2)
+    // Tests erase(it1, it2)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_sorted)
+    // Tests assign_sorted(first, last), assign_sorted_checked(first, last)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_checked_invalid)
+    // Tests assign_sorted_checked(first, last) errors
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_coalesce)
+    // Tests assign_sorted_coalesce(first, last)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many)
+    // Tests insert_many(first, last)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many_large)
+    // Tests insert_many(first, last) lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(unite)
+    // Tests unite(), operator|, operator|=, operator==
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect)
+    // Tests intersect(), operator&, operator&=
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect_large)
+    // Tests intersect(), operator& lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract)
+    // Tests subtract(), subtract(first, last), operator-, operator-=, operator^, operator^=
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract_large)
+    // Tests subtract(), operator- lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(gaps)
+    // Tests gaps(lo, hi), complement(lo, hi)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many)
+    // Tests find_many(first, last, out), contains_many(first, last, out)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many_large)
+    // Tests find_many(first, last, out), contains_many(first, last, out) strategies
+    DATA_CASE(common, set)
+  END
+}
+
+
+TEST_CASE("flat rangeset merge touching"){
+  FlatRangeSet<int> set;
+  BEGIN_PARAMS_SECTION(insert)
+    // Tests insert(pair), insert(start, end), const_iterator, cbegin, cend, size, 
+    DATA_CASE(simple, set)
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(remove)
+    // Tests remove(pair), remove(start, end) 
+    DATA_CASE(trivial, set)
+    DATA_CASE(one_range, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find1)
+    // Tests find(val)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find2)
+    // Tests find(start, end), find(pair)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+  
+  BEGIN_PARAMS_SECTION(erase1)
+    // Tests erase(it)
+    DATA_CASE(simple, set)
+  END
+
+  BEGIN_PARAMS_SECTION(erase2)
+    // Tests erase(it1, it2)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_sorted)
+    // Tests assign_sorted(first, last), assign_sorted_checked(first, last)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_checked_invalid)
+    // Tests assign_sorted_checked(first, last) errors
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_coalesce)
+    // Tests assign_sorted_coalesce(first, last)
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many)
+    // Tests insert_many(first, last)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many_large)
+    // Tests insert_many(first, last) lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(unite)
+    // Tests unite(), operator|, operator|=, operator==
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect)
+    // Tests intersect(), operator&, operator&=
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect_large)
+    // Tests intersect(), operator& lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract)
+    // Tests subtract(), subtract(first, last), operator-, operator-=, operator^, operator^=
+    DATA_CASE(common, set)
+    DATA_CASE(merge_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract_large)
+    // Tests subtract(), operator- lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(gaps)
+    // Tests gaps(lo, hi), complement(lo, hi)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many)
+    // Tests find_many(first, last, out), contains_many(first, last, out)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many_large)
+    // Tests find_many(first, last, out), contains_many(first, last, out) strategies
+    DATA_CASE(common, set)
+  END
+}
+
+TEST_CASE("flat rangeset keep touching"){
+  FlatRangeSet<int, false> set;
+  BEGIN_PARAMS_SECTION(insert)
+    // Tests insert(pair), insert(start, end), const_iterator, cbegin, cend, size, 
+    DATA_CASE(simple, set)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(remove)
+    // Tests remove(pair), remove(start, end) 
+    DATA_CASE(trivial, set)
+    DATA_CASE(one_range, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find1)
+    // Tests find(val)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find2)
+    // Tests find(start, end), find(pair)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+  
+  BEGIN_PARAMS_SECTION(erase1)
+    // Tests erase(it)
+    DATA_CASE(simple, set)
+  END
+  
+  BEGIN_PARAMS_SECTION(erase2)
+    // Tests erase(it1, it2)
+    DATA_CASE(simple, set)
+    DATA_CASE(three_ranges, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_sorted)
+    // Tests assign_sorted(first, last), assign_sorted_checked(first, last)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_checked_invalid)
+    // Tests assign_sorted_checked(first, last) errors
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(assign_coalesce)
+    // Tests assign_sorted_coalesce(first, last)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many)
+    // Tests insert_many(first, last)
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(insert_many_large)
+    // Tests insert_many(first, last) lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(unite)
+    // Tests unite(), operator|, operator|=, operator==
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect)
+    // Tests intersect(), operator&, operator&=
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(intersect_large)
+    // Tests intersect(), operator& lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract)
+    // Tests subtract(), subtract(first, last), operator-, operator-=, operator^, operator^=
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(subtract_large)
+    // Tests subtract(), operator- lookup strategies
+    DATA_CASE(common, set)
+  END
+
+  BEGIN_PARAMS_SECTION(gaps)
+    // Tests gaps(lo, hi), complement(lo, hi)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many)
+    // Tests find_many(first, last, out), contains_many(first, last, out)
+    DATA_CASE(common, set)
+    DATA_CASE(keep_touching, set)
+  END
+
+  BEGIN_PARAMS_SECTION(find_many_large)
+    // Tests find_many(first, last, out), contains_many(first, last, out) strategies
+    DATA_CASE(common, set)
+  END
+}
+
+
+TEST_CASE("(old test cases) rangeset merge touching insert2"){
+  RangeSet<int> set{};
+  assert_state(set);
+  assert_rangeset_equals({}, set);
+  set.insert(10, 20);
+  assert_state(set);
+  assert_rangeset_equals({
+    {10, 20},
+  }, set);
+  
+  set.insert(30, 40);
+  assert_state(set);
+  assert_rangeset_equals({
+    {10, 20},
+    {30, 40},
+  }, set);
+  
+  set.insert(50, 60);
+  set.insert(70, 80);
+  set.insert(90, 100);
+  
+  assert_state(set);
+  assert_rangeset_equals({
+    {10, 20},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 100},
+  }, set);
+  
+  set.insert(30, 40);
+  assert_state(set);
+  assert_rangeset_equals({
+    {10, 20},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 100},
+  }, set);
+  
+  set.insert(8, 10);
+  assert_state(set);
+  assert_rangeset_equals({
+    {8, 20},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 100},
+  }, set);
+
+  set.insert(6, 10);
+  assert_state(set);
+  assert_rangeset_equals({
+    {6, 20},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 100},
+  }, set);
+  
+  set.insert(5, 22);
+  assert_state(set);
+  assert_rangeset_equals({
+    {5, 22},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 100},
+  }, set);
+  
+  set.insert(100, 105);
+  assert_state(set);
+  assert_rangeset_equals({
+    {5, 22},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 105},
+  }, set);
+  
+  set.insert(100, 107);
+  assert_state(set);
+  assert_rangeset_equals({
+    {5, 22},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {90, 107},
+  }, set);
+
+  set.insert(88, 110);
+  assert_state(set);
+  assert_rangeset_equals({
+    {5, 22},
+    {30, 40},
+    {50, 60},
+    {70, 80},
+    {88, 110},
+  }, set);
+  
+  set.insert(22, 30);
+  assert_state(set);
+  assert_rangeset_equals({
+    {5, 40},
+    {50, 60},
+    {70, 80},
+    {88, 110},
+  }, set);
+  
+  set.insert(20, 55);
+  assert_state(set);
+  assert_rangeset_equals({
     {5, 60},
     {70, 80},
     {88, 110},
@@ -1755,3 +3207,1276 @@ TEST_CASE("(old test cases) rangeset merge touching delete2"){
 }
 
 }
+
+namespace test_rangeset{
+
+template <typename T>
+void check_integral_kernel(){
+  // Ranges [k*step, k*step + 3) starting at the lowest value of T, plus one ending at the max value
+  const T step = 7;
+  const T lo = std::numeric_limits<T>::min();
+  const T hi = std::numeric_limits<T>::max();
+  for(size_t n : {0, 1, 2, 3, 5, 15, 16, 17, 33, 100}){
+    FlatRangeSet<T> set;
+    std::vector<std::pair<T, T>> ranges;
+    for(size_t k = 0 ; k < n ; ++k){
+      ranges.emplace_back(lo + T(k * step), lo + T(k * step + 3));
+    }
+    ranges.emplace_back(hi - 10, hi);
+    set.assign_sorted(ranges.begin(), ranges.end());
+    std::vector<T> values{lo, hi, T(hi - 1), T(hi - 10), T(hi - 11), T(0), T(lo + 1)};
+    for(size_t k = 0 ; k < n * step + 2 ; ++k){
+      values.push_back(lo + T(k));
+    }
+    for(T v : values){
+      bool expected = false;
+      for(auto && r : ranges){
+        expected = expected || (r.first <= v && v < r.second);
+      }
+      REQUIRE(set.contains(v) == expected);
+    }
+  }
+}
+
+TEST_CASE("flat rangeset integral kernel"){
+  using rangeset_detail::kernel_path;
+  std::vector<kernel_path> paths{kernel_path::automatic, kernel_path::scalar};
+#ifdef RANGESET_SIMD_AVX2
+  if(rangeset_detail::cpu_has_avx2()){
+    paths.push_back(kernel_path::avx2);
+  }
+#endif
+  for(kernel_path path : paths){
+    rangeset_detail::kernel_override = path;
+    check_integral_kernel<int32_t>();
+    check_integral_kernel<uint32_t>();
+    check_integral_kernel<int64_t>();
+    check_integral_kernel<uint64_t>();
+    check_integral_kernel<uint16_t>();
+  }
+  rangeset_detail::kernel_override = kernel_path::automatic;
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set>
+void check_freeze(){
+  for(int n : {0, 1, 2, 3, 7, 8, 9, 100, 1000}){
+    Set set;
+    for(int i = 0 ; i < n ; ++i){
+      set.insert(10 * i, 10 * i + 6);
+    }
+    auto && frozen = set.freeze();
+    REQUIRE(frozen.size() == set.size());
+    REQUIRE(std::equal(frozen.cbegin(), frozen.cend(), set.cbegin(), set.cend()));
+    for(int v = -5 ; v < 10 * n + 5 ; ++v){
+      auto && it = set.find(v);
+      auto && fit = frozen.find(v);
+      REQUIRE((it == set.cend()) == (fit == frozen.cend()));
+      if(it != set.cend()){
+        REQUIRE(*it == *fit);
+      }
+      REQUIRE(frozen.contains(v) == set.contains(v));
+    }
+  }
+}
+
+TEST_CASE("freeze"){
+  check_freeze<RangeSet<int>>();
+  check_freeze<RangeSet<int, false>>();
+  check_freeze<FlatRangeSet<int>>();
+  check_freeze<FlatRangeSet<int, false>>();
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename T>
+std::vector<std::pair<T, T>> roaring_ranges(const RoaringRangeSet<T> & set){
+  return std::vector<std::pair<T, T>>(set.cbegin(), set.cend());
+}
+
+template <typename T>
+void check_roaring(T base){
+  using chunk_t = typename RoaringRangeSet<T>::chunk_t;
+  using ranges = std::vector<std::pair<T, T>>;
+  RoaringRangeSet<T> set;
+  REQUIRE(set.cbegin() == set.cend());
+  REQUIRE(set.find(base) == set.cend());
+
+  // Few ranges : run list
+  set.insert(base + 10, base + 20);
+  set.insert(base + 20, base + 30);
+  set.insert(base + 50, base + 60);
+  REQUIRE(roaring_ranges(set) == ranges{{base + 10, base + 30}, {base + 50, base + 60}});
+  REQUIRE(set.data.begin()->second.kind == chunk_t::RUNS);
+  REQUIRE(*set.find(base + 15) == std::pair<T, T>{base + 10, base + 30});
+  REQUIRE(set.find(base + 30) == set.cend());
+  REQUIRE(set.find(base + 12, base + 30) != set.cend());
+  REQUIRE(set.find(base + 12, base + 31) == set.cend());
+
+  // Isolated values : array
+  set.remove(base, base + 100);
+  REQUIRE(set.cbegin() == set.cend());
+  REQUIRE(set.data.empty());
+  for(T i = 0 ; i < 1000 ; ++i){
+    set.insert(base + 2 * i, base + 2 * i + 1);
+  }
+  REQUIRE(set.data.begin()->second.kind == chunk_t::ARRAY);
+  REQUIRE(set.size() == 1000);
+  REQUIRE(set.cardinality() == 1000);
+
+  // Many isolated values : bitmap
+  for(T i = 1000 ; i < 10000 ; ++i){
+    set.insert(base + 2 * i, base + 2 * i + 1);
+  }
+  REQUIRE(set.data.begin()->second.kind == chunk_t::BITMAP);
+  REQUIRE(set.size() == 10000);
+  REQUIRE(set.contains(base + 1000));
+  REQUIRE(!set.contains(base + 1001));
+  REQUIRE(*set.find(base + 19998) == std::pair<T, T>{base + 19998, base + 19999});
+
+  // Filling the holes : back to a run list
+  set.insert(base, base + 20000);
+  REQUIRE(set.data.begin()->second.kind == chunk_t::RUNS);
+  REQUIRE(roaring_ranges(set) == ranges{{base, base + 20000}});
+
+  // Ranges crossing chunks are joined back
+  set.insert(base + 60000, base + 300000);
+  REQUIRE(set.data.size() == 5);
+  REQUIRE(roaring_ranges(set) == ranges{{base, base + 20000}, {base + 60000, base + 300000}});
+  REQUIRE(*set.find(base + 70000) == std::pair<T, T>{base + 60000, base + 300000});
+  REQUIRE(*set.find(base + 299999) == std::pair<T, T>{base + 60000, base + 300000});
+  REQUIRE(set.find(base + 300000) == set.cend());
+  set.remove(base + 131072, base + 131073);
+  REQUIRE(roaring_ranges(set) == ranges{{base, base + 20000}, {base + 60000, base + 131072}, {base + 131073, base + 300000}});
+  set.remove(base + 65536, base + 131072);
+  REQUIRE(roaring_ranges(set) == ranges{{base, base + 20000}, {base + 60000, base + 65536}, {base + 131073, base + 300000}});
+  REQUIRE(set.cardinality() == 20000 + 5536 + 168927);
+
+  RoaringRangeSet<T> other;
+  other.insert(base + 131073, base + 300000);
+  other.insert(base + 60000, base + 65536);
+  other.insert(base, base + 20000);
+  REQUIRE(other == set);
+  other.remove(base, base + 1);
+  REQUIRE(other != set);
+}
+
+TEST_CASE("roaring rangeset"){
+  check_roaring<uint32_t>(0);
+  check_roaring<uint32_t>(std::numeric_limits<uint32_t>::max() - 300001);
+  check_roaring<uint64_t>(uint64_t(1) << 40);
+  check_roaring<uint64_t>(std::numeric_limits<uint64_t>::max() - 300001);
+
+  // Fragmented sets are much smaller than one node per range
+  RoaringRangeSet<uint32_t> set;
+  RangeSet<uint32_t> tree;
+  for(uint32_t i = 0 ; i < 100000 ; ++i){
+    set.insert(3 * i, 3 * i + 1 + i % 2);
+    tree.insert(3 * i, 3 * i + 1 + i % 2);
+  }
+  REQUIRE(std::equal(set.cbegin(), set.cend(), tree.cbegin(), tree.cend()));
+  REQUIRE(set.memory_usage() * 10 < tree.size() * (sizeof(std::pair<uint32_t, uint32_t>) + 4 * sizeof(void *)));
+}
+
+}
+
+namespace test_rangeset{
+
+/**
+ * Memory resource counting the allocations it forwards to new / delete.
+ */
+struct counting_resource : std::pmr::memory_resource{
+  size_t allocated = 0;
+  size_t deallocated = 0;
+
+  void * do_allocate(size_t bytes, size_t align) override {
+    ++allocated;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void * p, size_t bytes, size_t align) override {
+    ++deallocated;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const std::pmr::memory_resource & oth) const noexcept override {
+    return this == &oth;
+  }
+};
+
+template <typename Set>
+void check_pmr(){
+  counting_resource r1, r2;
+  {
+    Set set{&r1};
+    set.insert(0, 10);
+    set.insert(20, 30);
+    set.remove(4, 6);
+    assert_rangeset_equals({{0, 4}, {6, 10}, {20, 30}}, set);
+    assert_state(set);
+    REQUIRE(r1.allocated > 0);
+    REQUIRE(set.get_allocator().resource() == &r1);
+
+    // Copies get the default resource, like std::pmr containers
+    Set copy{set};
+    REQUIRE(copy.get_allocator().resource() == std::pmr::get_default_resource());
+    assert_rangesets_equal(set, copy);
+
+    Set other{set, &r2};
+    REQUIRE(other.get_allocator().resource() == &r2);
+    REQUIRE(r2.allocated > 0);
+    assert_rangesets_equal(set, other);
+
+    // Moving keeps the resource
+    Set moved{std::move(other)};
+    REQUIRE(moved.get_allocator().resource() == &r2);
+    assert_rangesets_equal(set, moved);
+
+    // Assignment does not propagate it
+    Set assigned{&r2};
+    assigned = set;
+    REQUIRE(assigned.get_allocator().resource() == &r2);
+    assert_rangesets_equal(set, assigned);
+    assigned.insert(40, 50);
+    Set target{&r1};
+    target = std::move(assigned);
+    REQUIRE(target.get_allocator().resource() == &r1);
+    assert_rangeset_equals({{0, 4}, {6, 10}, {20, 30}, {40, 50}}, target);
+
+    Set swapped{&r1};
+    swap(swapped, target);
+    assert_rangeset_equals({{0, 4}, {6, 10}, {20, 30}, {40, 50}}, swapped);
+    REQUIRE(target.size() == 0);
+
+    // Results of the operators use the allocator of the left operand
+    REQUIRE((set | moved).get_allocator().resource() == &r1);
+    REQUIRE((set & moved).get_allocator().resource() == &r1);
+    REQUIRE((set - moved).get_allocator().resource() == &r1);
+    REQUIRE((set ^ moved).get_allocator().resource() == &r1);
+    REQUIRE((moved | swapped).get_allocator().resource() == &r2);
+    REQUIRE(set.complement(0, 100).get_allocator().resource() == &r1);
+    assert_rangeset_equals({{40, 50}}, swapped - set);
+  }
+  REQUIRE(r1.allocated == r1.deallocated);
+  REQUIRE(r2.allocated == r2.deallocated);
+}
+
+// Moves do not throw, so that containers of sets move them when they grow. With an allocator that may differ and is not propagated, the move assignment may have to copy
+static_assert(std::is_nothrow_move_constructible_v<RangeSet<int>>);
+static_assert(std::is_nothrow_move_assignable_v<RangeSet<int>>);
+static_assert(std::is_nothrow_move_constructible_v<PooledRangeSet<int>>);
+static_assert(std::is_nothrow_move_constructible_v<pmr::RangeSet<int>>);
+static_assert(!std::is_nothrow_move_assignable_v<pmr::RangeSet<int>>);
+static_assert(std::is_nothrow_move_constructible_v<FlatRangeSet<int>>);
+
+TEST_CASE("allocator"){
+  check_pmr<pmr::RangeSet<int>>();
+  check_pmr<pmr::RangeSet<int, false>>();
+  check_pmr<pmr::FlatRangeSet<int>>();
+  check_pmr<pmr::FlatRangeSet<int, false>>();
+
+  // All the nodes come from the arena
+  counting_resource upstream;
+  {
+    std::pmr::monotonic_buffer_resource arena{&upstream};
+    pmr::RangeSet<int> set{&arena};
+    for(int i = 0 ; i < 1000 ; ++i){
+      set.insert(3 * i, 3 * i + 1);
+    }
+    REQUIRE(set.size() == 1000);
+    REQUIRE(upstream.allocated < 20);
+  }
+  REQUIRE(upstream.allocated == upstream.deallocated);
+}
+
+}
+
+namespace test_rangeset{
+
+TEST_CASE("pool allocator"){
+  PooledRangeSet<int> set;
+  RangeSet<int> expected;
+  auto && churn = [&](int seed){
+    for(int i = 0 ; i < 1000 ; ++i){
+      int v = (i * 7919 + seed) % 2000;
+      if(i % 2){
+        set.insert(v, v + 3);
+        expected.insert(v, v + 3);
+      }
+      else {
+        set.remove(v, v + 1);
+        expected.remove(v, v + 1);
+      }
+    }
+  };
+  churn(0);
+  assert_state(set);
+  REQUIRE(std::equal(set.cbegin(), set.cend(), expected.cbegin(), expected.cend()));
+  auto && stats = set.get_allocator().stats();
+  REQUIRE(stats.allocations - stats.deallocations == set.size());
+  REQUIRE(stats.reused > 0);
+
+  // Steady state : the freed nodes are recycled, operator new is not called anymore
+  for(int seed = 1 ; seed < 10 ; ++seed){
+    size_t system_allocations = stats.system_allocations;
+    set.remove(0, 3000);
+    expected.remove(0, 3000);
+    churn(seed);
+    REQUIRE(std::equal(set.cbegin(), set.cend(), expected.cbegin(), expected.cend()));
+    if(seed > 1){
+      REQUIRE(stats.system_allocations == system_allocations);
+    }
+  }
+  REQUIRE(stats.saved() > 10 * stats.system_allocations);
+
+  // Copies get their own pool, results of the operators share the one of their left operand
+  PooledRangeSet<int> copy{set};
+  REQUIRE(copy.get_allocator() != set.get_allocator());
+  REQUIRE(copy == set);
+  REQUIRE((set | copy).get_allocator() == set.get_allocator());
+  PooledRangeSet<int> moved{std::move(copy)};
+  REQUIRE(moved == set);
+  copy.insert(0, 10); // The moved from set is still usable
+  assert_rangeset_equals({{0, 10}}, copy);
+  swap(moved, copy);
+  assert_rangeset_equals({{0, 10}}, moved);
+  REQUIRE(copy == set);
+}
+
+/**
+ * End point aligned beyond what operator new guarantees, so that the pool hands its nodes to the aligned operator new.
+ */
+struct over_aligned{
+  alignas(32) int v;
+
+  over_aligned(int v) : v{v} {}
+
+  bool operator<(const over_aligned & oth) const { return v < oth.v; }
+  bool operator==(const over_aligned & oth) const { return v == oth.v; }
+};
+
+TEST_CASE("pool allocator over aligned"){
+  PooledRangeSet<over_aligned> set;
+  for(int i = 0 ; i < 100 ; ++i){
+    set.insert(over_aligned{4 * i}, over_aligned{4 * i + 2});
+  }
+  set.remove(over_aligned{0}, over_aligned{200});
+  REQUIRE(set.size() == 50);
+  for(auto && r : set){
+    REQUIRE(reinterpret_cast<uintptr_t>(&r) % 32 == 0);
+  }
+  auto && stats = set.get_allocator().stats();
+  REQUIRE(stats.system_allocations == stats.allocations);
+  REQUIRE(stats.allocations - stats.deallocations == set.size());
+}
+
+}
+
+namespace test_rangeset{
+
+/**
+ * End point counting its copies.
+ */
+struct counted{
+  int v;
+  static inline size_t copies = 0;
+
+  counted(int v) : v{v} {}
+  counted(const counted & oth) : v{oth.v} { ++copies; }
+  counted(counted &&)=default;
+  counted & operator=(const counted & oth){ v = oth.v; ++copies; return *this; }
+  counted & operator=(counted &&)=default;
+
+  bool operator<(const counted & oth) const { return v < oth.v; }
+  bool operator==(const counted & oth) const { return v == oth.v; }
+};
+
+template <typename Set>
+void check_move_bounds(){
+  Set set;
+  counted::copies = 0;
+  set.insert(counted{10}, counted{20});
+  set.insert(counted{30}, counted{40});
+  set.insert(counted{15}, counted{35}); // Merges all
+  set.insert(counted{0}, counted{50}); // Extends both bounds
+  set.remove(counted{5}, counted{45}); // Splits
+  set.remove(counted{0}, counted{1});
+  set.insert(std::pair<counted, counted>{60, 70});
+  set.remove(std::pair<counted, counted>{65, 66});
+  REQUIRE(counted::copies == 0);
+  REQUIRE(set.size() == 4);
+  REQUIRE(set.contains(counted{4}));
+  REQUIRE(!set.contains(counted{5}));
+  REQUIRE(set.contains(counted{45}));
+
+  counted start{80}, end{90};
+  set.insert(start, end);
+  REQUIRE(counted::copies == 2);
+}
+
+template <typename Set, typename Ref>
+void check_reversed_order(){
+  // [a, b) in Set (ordered by std::greater) is [-a, -b) in Ref
+  Set set, other;
+  Ref ref, ref_other;
+  for(int i = 0 ; i < 200 ; ++i){
+    int a = (i * 37) % 500, b = a - (i * 11) % 23;
+    if(i % 3){
+      set.insert(a, b);
+      ref.insert(-a, -b);
+    }
+    else {
+      set.remove(a, b);
+      ref.remove(-a, -b);
+    }
+    other.insert(b, b - 5);
+    ref_other.insert(-b, -b + 5);
+  }
+  auto && check = [](const Set & set, const Ref & ref){
+    REQUIRE(set.size() == ref.size());
+    auto && it = set.cbegin();
+    for(auto && r : std::vector<std::pair<int, int>>(ref.cbegin(), ref.cend())){
+      REQUIRE(it->first == -r.first);
+      REQUIRE(it->second == -r.second);
+      ++it;
+    }
+    for(int v = -10 ; v < 510 ; ++v){
+      REQUIRE(set.contains(v) == ref.contains(-v));
+    }
+  };
+  assert_state(set);
+  check(set, ref);
+  check(set | other, ref | ref_other);
+  check(set & other, ref & ref_other);
+  check(set - other, ref - ref_other);
+  check(set ^ other, ref ^ ref_other);
+  check(set.complement(400, 100), ref.complement(-400, -100));
+  auto && frozen = set.freeze();
+  for(int v = -10 ; v < 510 ; ++v){
+    REQUIRE(frozen.contains(v) == ref.contains(-v));
+  }
+}
+
+TEST_CASE("compare and move"){
+  check_move_bounds<RangeSet<counted>>();
+  check_move_bounds<RangeSet<counted, false>>();
+  check_move_bounds<FlatRangeSet<counted>>();
+  check_move_bounds<FlatRangeSet<counted, false>>();
+
+  check_reversed_order<RangeSet<int, true, std::greater<int>>, RangeSet<int>>();
+  check_reversed_order<RangeSet<int, false, std::greater<int>>, RangeSet<int, false>>();
+  check_reversed_order<FlatRangeSet<int, true, std::greater<int>>, FlatRangeSet<int>>();
+  check_reversed_order<FlatRangeSet<int, false, std::greater<int>>, FlatRangeSet<int, false>>();
+
+  // Heterogeneous lookups
+  RangeSet<std::string, true, std::less<>> words;
+  words.insert("b", "d");
+  words.insert(std::string{"m"}, std::string{"p"});
+  REQUIRE(words.contains(std::string_view{"c"}));
+  REQUIRE(words.contains("cat"));
+  REQUIRE(!words.contains("d"));
+  REQUIRE(words.find(std::string_view{"n"})->first == "m");
+  FlatRangeSet<std::string, true, std::less<>> flat_words;
+  flat_words.insert("b", "d");
+  REQUIRE(flat_words.contains(std::string_view{"cat"}));
+  REQUIRE(!flat_words.contains("e"));
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set>
+void check_hinted_insert(){
+  // Deterministic stream mixing increasing, touching, overlapping and out of order ranges
+  std::vector<std::pair<int, int>> stream;
+  unsigned x = 12345;
+  int pos = 0;
+  for(int i = 0 ; i < 2000 ; ++i){
+    x = x * 1103515245 + 12345;
+    unsigned r = (x >> 16) % 16;
+    if(r < 10){
+      pos += (r % 3) - 1 + static_cast<int>(r / 5);
+    }
+    else if(r < 14){
+      pos -= static_cast<int>(r);
+    }
+    stream.emplace_back(pos, pos + static_cast<int>(r % 4));
+    pos += static_cast<int>(r % 4);
+  }
+  Set ref, hinted, wrong, appended;
+  auto && hint = hinted.cend();
+  for(auto && r : stream){
+    ref.insert(r.first, r.second);
+    hint = hinted.insert(hint, r.first, r.second);
+    if(r.first < r.second){
+      REQUIRE(hint != hinted.cend());
+      REQUIRE(!(r.first < hint->first));
+      REQUIRE(!(hint->second < r.second));
+    }
+    else {
+      REQUIRE(hint == hinted.cend());
+    }
+    auto && w = wrong.insert(wrong.cbegin(), r.first, r.second);
+    if(r.first < r.second){
+      REQUIRE(*w == *wrong.find(r.first));
+    }
+    appended.append(r.first, r.second);
+    REQUIRE(hinted == ref);
+    REQUIRE(wrong == ref);
+    REQUIRE(appended == ref);
+  }
+  assert_state(hinted);
+  assert_state(appended);
+
+  // Monotonic stream : the hint is always right
+  Set seq, seq_ref;
+  hint = seq.cend();
+  for(int i = 0 ; i < 100 ; ++i){
+    hint = seq.insert(hint, 3 * i, 3 * i + 1 + i % 3);
+    seq_ref.insert(3 * i, 3 * i + 1 + i % 3);
+  }
+  REQUIRE(seq == seq_ref);
+  int a = 1000, b = 1002;
+  seq.append(std::move(a), std::move(b));
+  seq.insert(seq.cend(), 2000, 2001);
+  REQUIRE(std::prev(seq.cend())->first == 2000);
+  REQUIRE(seq.contains(1001));
+}
+
+TEST_CASE("hinted insert and append"){
+  check_hinted_insert<RangeSet<int>>();
+  check_hinted_insert<RangeSet<int, false>>();
+  check_hinted_insert<FlatRangeSet<int>>();
+  check_hinted_insert<FlatRangeSet<int, false>>();
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set, bool MERGE_TOUCHING>
+void check_buffered(size_t max_pending){
+  BufferedRangeSet<int, MERGE_TOUCHING, Set> buffered{max_pending};
+  Set ref;
+  unsigned x = 777;
+  for(int i = 0 ; i < 3000 ; ++i){
+    x = x * 1103515245 + 12345;
+    int start = static_cast<int>((x >> 8) % 500);
+    int end = start + static_cast<int>((x >> 4) % 13);
+    // Bursts of inserts and removes, of random lengths
+    if((x >> 20) % 3){
+      buffered.insert(start, end);
+      ref.insert(start, end);
+    }
+    else {
+      buffered.remove(start, end);
+      ref.remove(start, end);
+    }
+    REQUIRE(buffered.pending() < max_pending);
+    if(i % 97 == 0){
+      REQUIRE(buffered.contains(start) == ref.contains(start));
+      REQUIRE(buffered.pending() == 0);
+      REQUIRE(buffered.get() == ref);
+    }
+  }
+  REQUIRE(buffered.size() == ref.size());
+  REQUIRE(std::equal(buffered.cbegin(), buffered.cend(), ref.cbegin(), ref.cend()));
+  assert_state(buffered.get());
+
+  BufferedRangeSet<int, MERGE_TOUCHING, Set> seeded{ref};
+  seeded.remove(0, 250);
+  seeded.insert(100, 110);
+  seeded.remove(105, 106);
+  seeded.insert(0, 0);
+  REQUIRE(seeded.pending() == 3);
+  ref.remove(0, 250);
+  ref.insert(100, 110);
+  ref.remove(105, 106);
+  REQUIRE(seeded.get() == ref);
+  REQUIRE(seeded.find(107)->first == 106);
+}
+
+TEST_CASE("buffered rangeset"){
+  for(size_t max_pending : {size_t(1), size_t(7), size_t(4096)}){
+    check_buffered<RangeSet<int>, true>(max_pending);
+    check_buffered<RangeSet<int, false>, false>(max_pending);
+    check_buffered<FlatRangeSet<int>, true>(max_pending);
+    check_buffered<FlatRangeSet<int, false>, false>(max_pending);
+  }
+}
+
+// BufferedRangeSet checks that its MERGE_TOUCHING is the one of Set
+static_assert(RangeSet<int>::merge_touching && !RangeSet<int, false>::merge_touching);
+static_assert(FlatRangeSet<int>::merge_touching && !FlatRangeSet<int, false>::merge_touching);
+static_assert(!PooledRangeSet<int, false>::merge_touching);
+
+}
+
+namespace test_rangeset{
+
+/**
+ * Check the links, the heap order of the priorities and the aggregates of the tree of set, returning its sum.
+ */
+template <typename Node, typename Links>
+auto check_tree_node(const Links * n, const Links * parent) -> decltype(Node::sum){
+  decltype(Node::sum) sum{};
+  if(!n){
+    return sum;
+  }
+  auto && node = static_cast<const Node &>(*n);
+  REQUIRE(n->parent == parent);
+  if(parent->parent){ // Not the header
+    REQUIRE(node.priority <= static_cast<const Node *>(parent)->priority);
+  }
+  sum += check_tree_node<Node>(n->left, n);
+  sum += check_tree_node<Node>(n->right, n);
+  sum += rangeset_detail::range_length(node.value);
+  REQUIRE(node.sum == sum);
+  REQUIRE(n->count == 1 + rangeset_detail::tree_size(n->left) + rangeset_detail::tree_size(n->right));
+  auto && left = static_cast<const Node *>(n->left);
+  auto && right = static_cast<const Node *>(n->right);
+  REQUIRE(node.lo == (left ? left->lo : node.value.first));
+  REQUIRE(node.hi == (right ? right->hi : node.value.second));
+  auto gap = std::max(left ? std::max(left->gap, rangeset_detail::range_length(left->hi, node.value.first)) : 0, right ? std::max(right->gap, rangeset_detail::range_length(node.value.second, right->lo)) : 0);
+  REQUIRE(node.gap == gap);
+  return sum;
+}
+
+template <typename Set>
+void check_tree(const Set & set){
+  using node = rangeset_detail::tree_node<typename std::decay_t<decltype(*set.cbegin())>::first_type>;
+  // Before the right spine is fixed, measure() sums it
+  decltype(set.measure()) sum{};
+  for(auto && r : set){
+    sum += rangeset_detail::range_length(r);
+  }
+  REQUIRE(set.measure() == sum);
+  const_cast<Set &>(set).data.fix_spine();
+  REQUIRE(check_tree_node<node>(set.data.header.left, &set.data.header) == sum);
+  REQUIRE(set.data.begin().n == (set.data.header.left ? rangeset_detail::tree_leftmost(set.data.header.left) : &set.data.header));
+  REQUIRE(set.data.last().n == (set.data.header.left ? rangeset_detail::tree_rightmost(set.data.header.left) : &set.data.header));
+}
+
+// The links, the range and the aggregates of an int node fit in 64 bytes
+static_assert(sizeof(void *) != 8 || sizeof(rangeset_detail::tree_node<int>) == 64);
+
+template <typename Set, typename T>
+auto brute_measure(const Set & set, T lo, T hi){
+  rangeset_detail::measure_t<T> res{};
+  for(auto && r : set){
+    T a = std::max(r.first, lo), b = std::min(r.second, hi);
+    if(a < b){
+      res += b - a;
+    }
+  }
+  return res;
+}
+
+template <typename Set>
+void check_measure(){
+  Set set;
+  REQUIRE(set.measure() == 0);
+  REQUIRE(set.measure(0, 100) == 0);
+  set.insert(10, 20);
+  set.insert(30, 35);
+  REQUIRE(set.measure() == 15);
+  REQUIRE(set.measure(15, 32) == 7);
+  REQUIRE(set.measure(32, 15) == 0);
+  REQUIRE(set.measure(20, 30) == 0);
+  set.remove(12, 13);
+  REQUIRE(set.measure() == 14);
+
+  unsigned x = 4242;
+  for(int i = 0 ; i < 4000 ; ++i){
+    x = x * 1103515245 + 12345;
+    int start = static_cast<int>((x >> 8) % 1000);
+    int end = start + static_cast<int>((x >> 4) % 20);
+    switch((x >> 20) % 4){
+      case 0:
+        set.remove(start, end);
+        break;
+      case 1:
+        if(set.size()){
+          set.erase(set.find(start) == set.cend() ? set.cbegin() : set.find(start));
+        }
+        break;
+      default:
+        set.insert(start, end);
+    }
+    if(i % 50 == 0){
+      check_tree(set);
+      REQUIRE(set.measure() == brute_measure(set, -1, 2000));
+      for(int lo = -5 ; lo < 1030 ; lo += 37){
+        REQUIRE(set.measure(lo, lo + 101) == brute_measure(set, lo, lo + 101));
+      }
+    }
+  }
+  Set other;
+  other.insert(500, 700);
+  set -= other;
+  check_tree(set);
+  set &= Set{set.complement(0, 300)}.complement(0, 1000);
+  check_tree(set);
+  set |= other;
+  check_tree(set);
+  REQUIRE(set.measure() == brute_measure(set, -1, 2000));
+  Set moved{std::move(set)};
+  check_tree(moved);
+  check_tree(set);
+  swap(set, moved);
+  check_tree(set);
+  check_tree(moved);
+  REQUIRE(moved.measure() == 0);
+}
+
+TEST_CASE("measure"){
+  check_measure<RangeSet<int>>();
+  check_measure<RangeSet<int, false>>();
+  check_measure<PooledRangeSet<int>>();
+  check_measure<pmr::RangeSet<int>>();
+
+  // Total lengths that do not fit in T
+  RangeSet<int32_t> wide;
+  wide.insert(std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max());
+  REQUIRE(wide.measure() == 0xFFFFFFFFull);
+  REQUIRE(wide.measure(-10, 10) == 20);
+
+  RangeSet<double> reals;
+  reals.insert(0.5, 1.);
+  reals.insert(2., 2.25);
+  REQUIRE(reals.measure() == 0.75);
+  REQUIRE(reals.measure(0.75, 2.125) == 0.375);
+
+  // Reversed order : the lengths are still positive
+  RangeSet<int, true, std::greater<int>> reversed;
+  reversed.insert(20, 10);
+  reversed.insert(5, 0);
+  REQUIRE(reversed.measure() == 15);
+  REQUIRE(reversed.measure(15, 2) == 8);
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set>
+void check_order_statistics(){
+  Set set;
+  REQUIRE(set.nth(0) == set.cend());
+  REQUIRE(set.rank(0) == 0);
+  std::vector<std::pair<int, int>> ranges;
+  unsigned x = 99;
+  for(int i = 0 ; i < 3000 ; ++i){
+    x = x * 1103515245 + 12345;
+    int start = static_cast<int>((x >> 8) % 5000);
+    if((x >> 20) % 4){
+      set.insert(start, start + 1 + static_cast<int>((x >> 4) % 4));
+    }
+    else {
+      set.remove(start, start + 1);
+    }
+    if(i % 100 == 0){
+      ranges.assign(set.cbegin(), set.cend());
+      REQUIRE(set.nth(ranges.size()) == set.cend());
+      REQUIRE(set.nth(ranges.size() + 10) == set.cend());
+      REQUIRE(set.cend() - set.cbegin() == static_cast<long>(ranges.size()));
+      for(size_t k = 0 ; k < ranges.size() ; k += 7){
+        auto && it = set.nth(k);
+        REQUIRE(*it == ranges[k]);
+        REQUIRE(it - set.cbegin() == static_cast<long>(k));
+        REQUIRE(set.cbegin() + k == it);
+        REQUIRE(set.cend() - (ranges.size() - k) == it);
+        if(k + 3 <= ranges.size()){
+          auto && it2 = set.nth(k);
+          it2 += 3;
+          REQUIRE(it2 - it == 3);
+          it2 -= 3;
+          REQUIRE(it2 == it);
+        }
+        REQUIRE(set.rank(ranges[k].first) == k);
+        REQUIRE(set.rank(ranges[k].second - 1) == k);
+        REQUIRE(set.rank(ranges[k].second) == k + 1);
+        REQUIRE(set.rank(ranges[k].first - 1) == k - (k && ranges[k - 1].second == ranges[k].first));
+      }
+    }
+  }
+  REQUIRE(set.rank(-1) == 0);
+  REQUIRE(set.rank(100000) == set.size());
+}
+
+TEST_CASE("order statistics"){
+  check_order_statistics<RangeSet<int>>();
+  check_order_statistics<RangeSet<int, false>>();
+  check_order_statistics<FlatRangeSet<int>>();
+  check_order_statistics<FlatRangeSet<int, false>>();
+
+  RangeSet<std::string> words;
+  words.insert("b", "c");
+  words.insert("m", "n");
+  words.insert("x", "y");
+  REQUIRE(words.nth(1)->first == "m");
+  REQUIRE(words.rank("mm") == 1);
+  REQUIRE(words.rank("p") == 2);
+  REQUIRE(std::prev(words.cend()) - words.nth(0) == 2);
+}
+
+}
+
+namespace test_rangeset{
+
+/**
+ * Gaps of set inside [lo, hi), by walking it.
+ */
+template <typename Set, typename T>
+std::vector<std::pair<T, T>> brute_gaps(const Set & set, T lo, T hi){
+  std::vector<std::pair<T, T>> res;
+  for(auto && g : set.gaps(lo, hi)){
+    res.push_back(g);
+  }
+  return res;
+}
+
+template <typename Set>
+void check_find_gap(){
+  using T = typename std::decay_t<decltype(*Set{}.cbegin())>::first_type;
+  auto && check_gaps = [](const Set & set, T lo, T hi){
+    auto && gaps = brute_gaps(set, lo, hi);
+    for(T len : {T(1), T(3), T(8), T(20), T(50), T(200)}){
+      std::optional<std::pair<T, T>> first, best;
+      for(auto && g : gaps){
+        if(static_cast<T>(g.second - g.first) >= len){
+          if(!first){
+            first = g;
+          }
+          if(!best || g.second - g.first < best->second - best->first){
+            best = g;
+          }
+        }
+      }
+      REQUIRE(set.find_gap(len, lo, hi) == first);
+      REQUIRE(set.find_gap(len, lo, hi, RangeSetFit::best_fit) == best);
+    }
+  };
+  Set set;
+  REQUIRE(*set.find_gap(10, 0, 100) == std::pair<T, T>{0, 100});
+  REQUIRE(!set.find_gap(101, 0, 100));
+  unsigned x = 31337;
+  for(int i = 0 ; i < 2000 ; ++i){
+    x = x * 1103515245 + 12345;
+    T start = static_cast<T>((x >> 8) % 10000);
+    if((x >> 20) % 3){
+      set.insert(start, start + 1 + static_cast<T>((x >> 4) % 8));
+    }
+    else {
+      set.remove(start, start + 1 + static_cast<T>((x >> 4) % 40));
+    }
+    if(i % 40 == 0){
+      check_tree(set);
+      T lo = static_cast<T>((x >> 3) % 5000);
+      check_gaps(set, lo, lo + static_cast<T>((x >> 9) % 6000));
+    }
+  }
+
+  // Ranges appended in order leave the right spine of the tree stale : the searches must not trust it
+  Set appended;
+  for(int i = 0 ; i < 3000 ; ++i){
+    x = x * 1103515245 + 12345;
+    T start = static_cast<T>(10 * i + (x >> 8) % 5);
+    appended.append(start, start + 1 + static_cast<T>((x >> 4) % 300 == 0 ? 200 : (x >> 4) % 9));
+    if(i % 100 == 0){
+      T lo = static_cast<T>((x >> 3) % (10 * i + 1));
+      check_gaps(appended, lo, lo + static_cast<T>((x >> 9) % 6000));
+      REQUIRE(appended.measure(lo, lo + 500) == brute_measure(appended, lo, T(lo + 500)));
+    }
+  }
+  check_tree(appended);
+
+  // Allocations
+  Set space;
+  space.insert(0, 10);
+  space.insert(30, 32);
+  space.insert(40, 100);
+  REQUIRE(*space.find_gap(5, 0, 100, RangeSetFit::best_fit) == std::pair<T, T>{32, 40});
+  REQUIRE(*space.allocate(5, 0, 200) == std::pair<T, T>{10, 15});
+  REQUIRE(*space.allocate(5, 0, 200, RangeSetFit::best_fit) == std::pair<T, T>{32, 37});
+  REQUIRE(*space.allocate(4, 0, 200, RangeSetFit::next_fit) == std::pair<T, T>{15, 19});
+  REQUIRE(*space.allocate(4, 0, 200, RangeSetFit::next_fit) == std::pair<T, T>{19, 23});
+  REQUIRE(*space.allocate(10, 0, 200, RangeSetFit::next_fit) == std::pair<T, T>{100, 110});
+  REQUIRE(*space.allocate(3, 0, 200, RangeSetFit::next_fit) == std::pair<T, T>{110, 113});
+  REQUIRE(*space.allocate(87, 0, 200, RangeSetFit::next_fit) == std::pair<T, T>{113, 200});
+  // Wraps around
+  REQUIRE(*space.allocate(2, 0, 200, RangeSetFit::next_fit) == std::pair<T, T>{23, 25});
+  REQUIRE(!space.allocate(6, 0, 200));
+  REQUIRE(space.measure(0, 200) == 200 - 5 - 3);
+  check_tree(space);
+  REQUIRE(space.find_gap(1, 0, 200)->first == 23 + 2);
+}
+
+TEST_CASE("find gap"){
+  check_find_gap<RangeSet<int>>();
+  check_find_gap<RangeSet<int, false>>();
+  check_find_gap<RangeSet<uint64_t>>();
+  check_find_gap<PooledRangeSet<uint64_t>>();
+
+  // With len = 0, the empty gap between touching ranges is skipped
+  RangeSet<int, false> touching;
+  for(auto && r : std::initializer_list<std::pair<int, int>>{{15, 16}, {17, 50}, {64, 65}, {91, 117}, {117, 135}, {153, 165}, {168, 169}}){
+    touching.insert(r);
+  }
+  REQUIRE(touching.find_gap(0, 99, 169) == std::pair<int, int>{135, 153});
+  REQUIRE(touching.find_gap(0, 99, 169, RangeSetFit::best_fit) == std::pair<int, int>{165, 168});
+  REQUIRE(touching.find_gap(0, 117, 135) == std::nullopt);
+
+  // Whole domain
+  RangeSet<uint64_t> space;
+  REQUIRE(*space.allocate(1 << 20) == std::pair<uint64_t, uint64_t>{0, 1 << 20});
+  REQUIRE(space.find_gap(1)->second == std::numeric_limits<uint64_t>::max());
+  RangeSet<double> reals;
+  reals.insert(0., 1.);
+  reals.insert(1.5, 2.);
+  REQUIRE(*reals.find_gap(0.5, 0., 2.) == std::pair<double, double>{1., 1.5});
+
+  // Reversed order
+  RangeSet<int, true, std::greater<int>> down;
+  down.insert(100, 90);
+  REQUIRE(*down.allocate(5, 100, 0) == std::pair<int, int>{90, 85});
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set>
+void check_overlapping(){
+  Set set;
+  REQUIRE(set.overlapping(0, 10).empty());
+  REQUIRE(!set.intersects(0, 10));
+  REQUIRE(set.covers(5, 5));
+  unsigned x = 2024;
+  for(int i = 0 ; i < 600 ; ++i){
+    x = x * 1103515245 + 12345;
+    int start = static_cast<int>((x >> 8) % 2000);
+    if((x >> 20) % 3){
+      set.insert(start, start + 1 + static_cast<int>((x >> 4) % 10));
+    }
+    else {
+      set.remove(start, start + 1 + static_cast<int>((x >> 4) % 5));
+    }
+  }
+  for(int a = -3 ; a < 2020 ; a += 3){
+    for(int len : {0, 1, 2, 5, 17, 60}){
+      int b = a + len;
+      std::vector<std::pair<int, int>> expected;
+      bool covered = true;
+      for(int v = a ; v < b ; ++v){
+        covered = covered && set.contains(v);
+      }
+      for(auto && r : set){
+        if(a < b && r.first < b && a < r.second){
+          expected.push_back(r);
+        }
+      }
+      auto && view = set.overlapping(a, b);
+      REQUIRE(std::vector<std::pair<int, int>>(view.begin(), view.end()) == expected);
+      REQUIRE(view.size() == expected.size());
+      REQUIRE(set.intersects(a, b) == !expected.empty());
+      REQUIRE(set.covers(a, b) == (covered && (len == 0 || expected.size() == 1)));
+    }
+  }
+  REQUIRE(set.overlapping(10, 5).empty());
+  REQUIRE(!set.intersects(10, 5));
+}
+
+TEST_CASE("overlapping"){
+  check_overlapping<RangeSet<int>>();
+  check_overlapping<RangeSet<int, false>>();
+  check_overlapping<FlatRangeSet<int>>();
+  check_overlapping<FlatRangeSet<int, false>>();
+
+  RangeSet<int> set;
+  set.insert(0, 10);
+  set.insert(20, 30);
+  set.insert(40, 50);
+  auto && view = set.overlapping(5, 41);
+  REQUIRE(view.size() == 3);
+  REQUIRE(set.overlapping(10, 20).empty());
+  REQUIRE(set.overlapping(10, 21).begin()->first == 20);
+  REQUIRE(!set.intersects(30, 40));
+  REQUIRE(set.covers(20, 30));
+  REQUIRE(!set.covers(20, 31));
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set>
+void check_neighbours(){
+  Set set;
+  REQUIRE(set.lower_bound(0) == set.cend());
+  REQUIRE(set.upper_bound(0) == set.cend());
+  REQUIRE(set.nearest(0) == set.cend());
+  unsigned x = 7;
+  for(int i = 0 ; i < 300 ; ++i){
+    x = x * 1103515245 + 12345;
+    int start = static_cast<int>((x >> 8) % 3000);
+    set.insert(start, start + 1 + static_cast<int>((x >> 4) % 6));
+  }
+  for(int v = -5 ; v < 3020 ; ++v){
+    auto && lower = std::find_if(set.cbegin(), set.cend(), [&](auto && r){ return v < r.second; });
+    auto && upper = std::find_if(set.cbegin(), set.cend(), [&](auto && r){ return v < r.first; });
+    REQUIRE(set.lower_bound(v) == lower);
+    REQUIRE(set.upper_bound(v) == upper);
+    auto && nearest = set.nearest(v);
+    if(lower != set.cend() && !(v < lower->first)){
+      REQUIRE(nearest == lower);
+    }
+    else if(upper == set.cbegin()){
+      REQUIRE(nearest == upper);
+    }
+    else {
+      auto && prev = std::prev(upper);
+      REQUIRE(nearest == (upper == set.cend() || v - prev->second <= upper->first - v ? prev : upper));
+    }
+  }
+}
+
+TEST_CASE("neighbours"){
+  check_neighbours<RangeSet<int>>();
+  check_neighbours<RangeSet<int, false>>();
+  check_neighbours<FlatRangeSet<int>>();
+  check_neighbours<FlatRangeSet<int, false>>();
+
+  RangeSet<double> reals;
+  reals.insert(0., 1.);
+  reals.insert(3., 4.);
+  REQUIRE(reals.nearest(1.9)->first == 0.);
+  REQUIRE(reals.nearest(2.1)->first == 3.);
+  REQUIRE(reals.nearest(2.)->first == 0.);
+  REQUIRE(reals.nearest(10.)->first == 3.);
+  REQUIRE(reals.lower_bound(1.)->first == 3.);
+  REQUIRE(std::prev(reals.upper_bound(3.5))->first == 3.);
+
+  // Reversed order
+  RangeSet<int, true, std::greater<int>> down;
+  down.insert(10, 0);
+  down.insert(30, 20);
+  REQUIRE(down.lower_bound(15)->first == 10);
+  REQUIRE(down.upper_bound(25)->first == 10);
+  REQUIRE(down.nearest(14)->first == 10);
+  REQUIRE(down.nearest(16)->first == 30);
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set>
+void check_cursor(){
+  Set set;
+  auto && empty = set.cursor();
+  REQUIRE(empty.find(0) == set.cend());
+  REQUIRE(empty.position() == set.cend());
+  unsigned x = 11;
+  for(int i = 0 ; i < 300 ; ++i){
+    x = x * 1103515245 + 12345;
+    int start = static_cast<int>((x >> 8) % 3000);
+    set.insert(start, start + 1 + static_cast<int>((x >> 4) % 6));
+  }
+  auto && cursor = set.cursor();
+  REQUIRE(cursor.position() == set.cbegin());
+  // Forward, backward, then random jumps
+  for(int v = -5 ; v < 3020 ; ++v){
+    REQUIRE(cursor.find(v) == set.find(v));
+  }
+  for(int v = 3020 ; v > -5 ; v -= 3){
+    REQUIRE(cursor.contains(v) == set.contains(v));
+  }
+  for(int i = 0 ; i < 3000 ; ++i){
+    x = x * 1103515245 + 12345;
+    int v = static_cast<int>((x >> 8) % 3020) - 5;
+    auto && it = cursor.find(v);
+    REQUIRE(it == set.find(v));
+    if(it != set.cend()){
+      REQUIRE(cursor.position() == it);
+    }
+  }
+}
+
+TEST_CASE("cursor"){
+  check_cursor<RangeSet<int>>();
+  check_cursor<RangeSet<int, false>>();
+  check_cursor<FlatRangeSet<int>>();
+  check_cursor<FlatRangeSet<int, false>>();
+
+  // The cursor stays valid while its range is not erased
+  RangeSet<int> set;
+  set.insert(0, 10);
+  set.insert(20, 30);
+  auto && cursor = set.cursor();
+  REQUIRE(cursor.find(25)->first == 20);
+  set.insert(40, 50);
+  set.remove(0, 10);
+  REQUIRE(cursor.find(45)->first == 40);
+  REQUIRE(cursor.find(5) == set.cend());
+  REQUIRE(cursor.position() == set.cbegin());
+}
+
+}
+
+namespace test_rangeset{
+
+template <typename Set, bool MERGE_TOUCHING>
+void check_split_join(){
+  using ranges = std::vector<std::pair<int, int>>;
+  unsigned x = 5;
+  for(int round = 0 ; round < 40 ; ++round){
+    Set set;
+    for(int i = 0 ; i < 200 ; ++i){
+      x = x * 1103515245 + 12345;
+      int start = static_cast<int>((x >> 8) % 2000);
+      set.insert(start, start + 1 + static_cast<int>((x >> 4) % 8));
+    }
+    ranges before(set.cbegin(), set.cend());
+    x = x * 1103515245 + 12345;
+    int at = static_cast<int>((x >> 8) % 2040) - 20;
+    // Expected halves : the range containing at is cut
+    ranges lower, upper;
+    for(auto && r : before){
+      if(r.first < at){
+        lower.emplace_back(r.first, std::min(r.second, at));
+      }
+      if(at < r.second){
+        upper.emplace_back(std::max(r.first, at), r.second);
+      }
+    }
+    Set high = set.split(at);
+    check_tree(set);
+    check_tree(high);
+    REQUIRE(ranges(set.cbegin(), set.cend()) == lower);
+    REQUIRE(ranges(high.cbegin(), high.cend()) == upper);
+    REQUIRE(set.size() == lower.size());
+    REQUIRE(high.size() == upper.size());
+    set.join(std::move(high));
+    check_tree(set);
+    REQUIRE(high.size() == 0);
+    ranges joined = lower;
+    if(!(lower.size() == 0) && !upper.empty() && lower.back().second == upper.front().first && MERGE_TOUCHING){
+      joined.back().second = upper.front().second;
+      joined.insert(joined.end(), upper.begin() + 1, upper.end());
+    }
+    else {
+      joined.insert(joined.end(), upper.begin(), upper.end());
+    }
+    REQUIRE(ranges(set.cbegin(), set.cend()) == joined);
+    REQUIRE(set.size() == joined.size());
+
+    // Removing a large span drops whole subtrees
+    x = x * 1103515245 + 12345;
+    int lo = static_cast<int>((x >> 8) % 2000);
+    set.remove(lo, lo + 700);
+    check_tree(set);
+    for(auto && r : set){
+      REQUIRE((r.second <= lo || lo + 700 <= r.first));
+    }
+    REQUIRE(static_cast<size_t>(std::distance(set.cbegin(), set.cend())) == set.size());
+  }
+}
+
+TEST_CASE("split and join"){
+  check_split_join<RangeSet<int>, true>();
+  check_split_join<RangeSet<int, false>, false>();
+
+  RangeSet<int> set;
+  set.insert(0, 10);
+  set.insert(20, 30);
+  RangeSet<int> empty = set.split(40);
+  REQUIRE(empty.size() == 0);
+  RangeSet<int> all = set.split(-5);
+  REQUIRE(set.size() == 0);
+  REQUIRE(all.size() == 2);
+  set.join(std::move(all));
+  REQUIRE(set.size() == 2);
+
+  // The joined ranges must be after the set
+  RangeSet<int> overlapping;
+  overlapping.insert(25, 40);
+  REQUIRE_THROWS_AS(set.join(std::move(overlapping)), std::invalid_argument);
+  REQUIRE(set.size() == 2);
+  REQUIRE(overlapping.size() == 1);
+  RangeSet<int> touching;
+  touching.insert(30, 40);
+  set.join(std::move(touching));
+  REQUIRE(set.size() == 2);
+  REQUIRE(set.find(35)->first == 20);
+
+  // Different allocators : the ranges are moved one by one
+  counting_resource a, b;
+  pmr::RangeSet<int> left{&a}, right{&b};
+  left.insert(0, 10);
+  right.insert(20, 30);
+  right.insert(40, 50);
+  left.join(std::move(right));
+  REQUIRE(left.size() == 3);
+  REQUIRE(right.size() == 0);
+  pmr::RangeSet<int> split = left.split(25);
+  REQUIRE(split.get_allocator().resource() == &a);
+  REQUIRE(split.size() == 2);
+  REQUIRE(split.cbegin()->first == 25);
+}
+
+}
+
+#if __cplusplus >= 202002L
+#include <ranges>
+
+namespace test_rangeset{
+
+static_assert(std::bidirectional_iterator<RangeSet<int>::const_iterator>);
+static_assert(std::bidirectional_iterator<RangeSet<std::string>::const_iterator>);
+static_assert(std::bidirectional_iterator<FlatRangeSet<int>::const_iterator>);
+static_assert(std::bidirectional_iterator<FrozenRangeSet<int>::const_iterator>);
+static_assert(std::forward_iterator<RoaringRangeSet<uint32_t>::const_iterator>);
+static_assert(std::forward_iterator<RangeSetGaps<int, RangeSet<int>::const_iterator>::const_iterator>);
+static_assert(std::ranges::common_range<const RangeSet<int> &>);
+static_assert(std::ranges::bidirectional_range<const FlatRangeSet<int> &>);
+static_assert(std::ranges::bidirectional_range<RangeSetSpan<RangeSet<int>::const_iterator>>);
+// The iterators reference the ranges in place, whatever T
+static_assert(sizeof(RangeSet<std::string>::const_iterator) == sizeof(void *));
+static_assert(sizeof(FlatRangeSet<std::string>::const_iterator) == sizeof(void *));
+
+template <typename Set>
+void check_ranges(){
+  Set set;
+  set.insert(0, 10);
+  set.insert(20, 25);
+  set.insert(30, 40);
+  auto && it = std::ranges::find_if(set, [](const auto & r){ return r.second - r.first == 5; });
+  REQUIRE(it != set.end());
+  REQUIRE(it->first == 20);
+  REQUIRE(&*it == &*set.find(22));
+  REQUIRE(std::ranges::distance(set) == 3);
+  auto && reversed = set | std::views::reverse;
+  REQUIRE(std::ranges::begin(reversed)->first == 30);
+  std::vector<int> lengths;
+  for(int l : set | std::views::transform([](const auto & r){ return r.second - r.first; })){
+    lengths.push_back(l);
+  }
+  REQUIRE(lengths == std::vector<int>{10, 5, 10});
+  auto && view = set.gaps(0, 50);
+  REQUIRE(std::ranges::distance(view) == 3);
+}
+
+TEST_CASE("ranges"){
+  check_ranges<RangeSet<int>>();
+  check_ranges<RangeSet<int, false>>();
+  check_ranges<FlatRangeSet<int>>();
+  check_ranges<FlatRangeSet<int, false>>();
+}
+
+}
+#endif